@@ -8,7 +8,7 @@ $slangcPath = Join-Path -Path $env:VULKAN_SDK -ChildPath "bin/slangc.exe"
 $shaderSourcePath = Join-Path -Path $projectPath -ChildPath "src/shader.slang"
 $shaderOutputPath = Join-Path -Path $outputPath -ChildPath "shader.spv"
 
-Invoke-Expression "$slangcPath $shaderSourcePath -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry vertexShader -entry fragmentShader -o $shaderOutputPath"
+Invoke-Expression "$slangcPath $shaderSourcePath -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry vertexShader -entry fragmentShader -entry cullMeshlets -o $shaderOutputPath"
 
 $resourceDirectoryPath = Join-Path -Path $projectPath -ChildPath "res"
 
@@ -18,308 +18,1810 @@
 #include <utility>
 #include <atomic>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <string>
+#include <tuple>
+#include <set>
+#include <unordered_map>
+#include <bit>
+
+#include "obj.h"
 
-// MARK: Obj loader
+// MARK: Renderer frontmatter
+
+// Frames in flight are chosen at startup, up to this many. Fixed-size per-frame arrays are sized for the most.
+const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+// Must match `numthreads` on `cullMeshlets` in shader.slang.
+const uint32_t MESHLET_CULL_GROUP_SIZE = 64;
+// Default for how far, in pixels, a LOD's error may project on screen before a finer LOD is drawn instead.
+const float DEFAULT_LOD_ERROR_THRESHOLD = 1.0f;
+// Geometry is held in buffers of this size, created as resident meshes need them and destroyed once empty. A power of two, as it is
+// handed out in buddy ranges; meshes larger than a page get a page of their own.
+const VkDeviceSize GEOMETRY_PAGE_SIZE = 64ull << 20;
+// Where each part of a mesh's geometry starts within its range. Covers every device's `minStorageBufferOffsetAlignment`.
+const VkDeviceSize GEOMETRY_ALIGNMENT = 256;
+// What the staging ring holds for each frame in flight, and so the most a frame uploads.
+const VkDeviceSize STAGING_RING_FRAME_SIZE = 16ull << 20;
+// Alignment of staging ring ranges, so that they are written with aligned vector stores.
+const VkDeviceSize STAGING_ALIGNMENT = 16;
+// The share of a heap's budget new geometry pages may take it to. The rest is left to attachments, other processes and driver overhead.
+const double GPU_MEMORY_BUDGET_THRESHOLD = 0.9;
+// Frames a mesh must have gone unseen for before its geometry can be evicted. Far more than are ever in flight, so that nothing
+// evicted is still being read, and enough that turning the camera back and forth does not stream the same mesh over and over.
+const uint64_t GEOMETRY_EVICTION_DELAY_FRAMES = 120;
+// How long to wait for a present to reach the display before pacing carries on without it, e.g. while the window is hidden.
+const uint64_t PRESENT_WAIT_TIMEOUT_NS = 100'000'000;
+// Draws each recording thread takes at the least, below which handing them to another thread costs more than it saves.
+const size_t MIN_DRAWS_PER_RECORDING_THREAD = 64;
+// Frames between reports of how often cached command buffers were reused.
+const uint64_t COMMAND_BUFFER_CACHE_STATS_INTERVAL = 1000;
+// Meshes parsed at the same time. Each load splits its parse over its share of the cores, leaving one for the render thread.
+const unsigned ASSET_LOADER_THREADS = 2;
+
+// Vertex input locations the vertex shader reads: the position and the normal. Texcoords, at the location after them, are ignored.
+const uint32_t MESH_VERTEX_SHADER_INPUTS = 2;
+
+const std::array<const char *, 1> requiredInstanceLayers = {
+    "VK_LAYER_KHRONOS_validation",
+};
+
+const std::array<const char *, 3> requiredInstanceExtensions = {
+    VK_KHR_SURFACE_EXTENSION_NAME,
+    VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
+    VK_EXT_DEBUG_UTILS_EXTENSION_NAME,
+};
+
+const std::array<const char *, 4> requiredDeviceExtensions = {
+    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+    VK_KHR_SPIRV_1_4_EXTENSION_NAME,
+    VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME,
+    VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
+};
+
+// Enabled when the device has them.
+const std::array<const char *, 3> optionalDeviceExtensions = {
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+    VK_KHR_PRESENT_ID_EXTENSION_NAME,
+    VK_KHR_PRESENT_WAIT_EXTENSION_NAME,
+};
+
+struct Dimensions
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// Chosen at startup, from the command line.
+struct RendererSettings
+{
+    // More frames in flight let the CPU run further ahead of the GPU, trading latency for throughput.
+    uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+    // Falls back to FIFO, which every surface supports, when the surface does not support it.
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    // Swapchain images to ask for, or 0 for one more than the surface's minimum.
+    uint32_t swapchainImages = 0;
+    // Seconds from one present to the next to pace frames to, or 0 to present as fast as the present mode lets frames through.
+    double targetFrameTime = 0.0;
+    // Holds each frame back until the one before it has been presented, so that none queue up ahead of the display.
+    bool lowLatency = false;
+    // Seconds from the start of one frame to the next at the least, capping the frame rate, or 0 for no cap.
+    double minFrameTime = 0.0;
+    // Only draws when something has changed, e.g. the window's size or the meshes shown, and sleeps otherwise.
+    bool renderOnDemand = false;
+    // Threads draws are recorded on, including the render thread, or 0 for one per core.
+    uint32_t recordingThreads = 0;
+    // Reuses the frame's command buffer from the last time round while nothing it records has changed.
+    bool cacheCommandBuffers = false;
+    // Loads meshes with 16-bit positions and octahedral normals, at less than half the vertex size of floats.
+    bool quantizeVertices = true;
+    // Pixels a LOD's error may project to on screen. Higher values draw coarser LODs sooner.
+    float lodErrorThreshold = DEFAULT_LOD_ERROR_THRESHOLD;
+};
+
+struct UniformBufferObject
+{
+    glm::mat4 model;
+    glm::mat4 view;
+    glm::mat4 proj;
+    // Undoes the mesh's vertex quantization; see `Obj::getPositionDecode`. vec4 to match std140 layout.
+    glm::vec4 positionScale;
+    glm::vec4 positionOffset;
+    // Object-space frustum planes (xyz normal pointing inwards, w distance) and camera position, for meshlet culling.
+    glm::vec4 frustumPlanes[6];
+    glm::vec4 cameraPosition;
+    // The meshlets of the selected LOD.
+    uint32_t firstMeshlet;
+    uint32_t numMeshlets;
+    // Set when normals are two octahedral snorm16 values instead of three floats.
+    uint32_t octahedralNormals;
+    uint32_t padding;
+};
+
+// MARK: GPU memory
+
+// Device memory is allocated in blocks of this size, or an eighth of the heap on small heaps. Resources larger than half a block get a
+// block of their own.
+const VkDeviceSize GPU_MEMORY_BLOCK_SIZE = 64ull << 20;
+// The smallest range handed out within a block. Ranges are powers of two of this size, aligned to their size.
+const VkDeviceSize GPU_MEMORY_MIN_RANGE_SIZE = 256;
+
+// The free ranges of a power-of-two sized space, handed out buddy-style. A range of order n is `GPU_MEMORY_MIN_RANGE_SIZE << n` bytes and
+// aligned to its size; its buddy is the range it was split from, at its offset with bit n flipped.
+class BuddyRanges
+{
+public:
+    BuddyRanges() = default;
+
+    // `size` must be a power of two.
+    BuddyRanges(VkDeviceSize size) : freeRanges(getOrder(size) + 1)
+    {
+        freeRanges.back().insert(0);
+    }
+
+    // The order of the smallest range that holds `size` bytes.
+    static uint32_t getOrder(VkDeviceSize size)
+    {
+        return (uint32_t)std::countr_zero(std::bit_ceil(std::max(size, GPU_MEMORY_MIN_RANGE_SIZE)) / GPU_MEMORY_MIN_RANGE_SIZE);
+    }
+
+    // Takes the lowest free range of the smallest order that fits, splitting it down to `order`.
+    bool take(uint32_t order, VkDeviceSize &offset)
+    {
+        uint32_t available = order;
+
+        while (available < freeRanges.size() && freeRanges[available].empty())
+            available++;
+
+        if (available >= freeRanges.size())
+            return false;
+
+        offset = *freeRanges[available].begin();
+        freeRanges[available].erase(freeRanges[available].begin());
+
+        // Keep the lower half and free the upper one at each split.
+        while (available > order)
+        {
+            available--;
+            freeRanges[available].insert(offset + (GPU_MEMORY_MIN_RANGE_SIZE << available));
+        }
+
+        return true;
+    }
+
+    // Frees a range, merging it with its buddy for as long as the buddy is free too.
+    void give(uint32_t order, VkDeviceSize offset)
+    {
+        while (order + 1 < freeRanges.size() && freeRanges[order].erase(offset ^ (GPU_MEMORY_MIN_RANGE_SIZE << order)) > 0)
+        {
+            offset &= ~(GPU_MEMORY_MIN_RANGE_SIZE << order);
+            order++;
+        }
+
+        freeRanges[order].insert(offset);
+    }
+
+    VkDeviceSize getLargestFreeRange() const
+    {
+        for (uint32_t order = (uint32_t)freeRanges.size(); order-- > 0;)
+            if (freeRanges[order].empty() == false)
+                return GPU_MEMORY_MIN_RANGE_SIZE << order;
+
+        return 0;
+    }
+
+private:
+    std::vector<std::set<VkDeviceSize>> freeRanges = {};
+};
+
+// What memory is used for, so that it can be accounted for separately.
+enum GpuMemoryCategory : uint32_t
+{
+    GPU_MEMORY_GEOMETRY,
+    GPU_MEMORY_UNIFORMS,
+    GPU_MEMORY_DRAWS,
+    GPU_MEMORY_ATTACHMENTS,
+    GPU_MEMORY_STAGING,
+    GPU_MEMORY_CATEGORY_COUNT,
+};
+
+const std::array<const char *, GPU_MEMORY_CATEGORY_COUNT> gpuMemoryCategoryNames = {
+    "geometry",
+    "uniforms",
+    "draws",
+    "attachments",
+    "staging",
+};
+
+// A range of device memory a resource is bound to. `mapped` points at the start of the range when the memory is host-visible.
+struct GpuAllocation
+{
+    VkDeviceMemory memory = NULL;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void *mapped = nullptr;
+    GpuMemoryCategory category = GPU_MEMORY_CATEGORY_COUNT;
+
+    // Where the range came from, for `GpuMemoryAllocator::free`.
+    uint32_t pool = UINT32_MAX;
+    uint32_t block = UINT32_MAX;
+    uint32_t order = 0;
+};
+
+struct GpuMemoryStats
+{
+    uint32_t numBlocks = 0;
+    uint32_t numAllocations = 0;
+    VkDeviceSize blockBytes = 0;
+    // What resources asked for, and what they take up once rounded to a power of two.
+    VkDeviceSize requestedBytes = 0;
+    VkDeviceSize allocatedBytes = 0;
+    VkDeviceSize largestFreeRange = 0;
+    // What each category takes up.
+    std::array<VkDeviceSize, GPU_MEMORY_CATEGORY_COUNT> categoryBytes = {};
+};
+
+// How much of a heap is in use, by this process and others, and how much the driver reckons this process can use without trouble.
+struct GpuHeapBudget
+{
+    VkDeviceSize usage = 0;
+    VkDeviceSize budget = 0;
+};
+
+// Sub-allocates resources from large device memory blocks with a buddy allocator, so that the number of `vkAllocateMemory` calls grows
+// with the memory in use rather than with the number of resources. Buffers and optimal-tiling images come from separate blocks, which
+// keeps them from sharing a `bufferImageGranularity` page. Host-visible blocks stay mapped. Every allocation is accounted to a category and
+// a heap, and heaps are measured against their budget. Safe to use from any thread.
+class GpuMemoryAllocator
+{
+public:
+    // `memoryBudget` tells whether VK_EXT_memory_budget is enabled on `device`.
+    void initialize(VkPhysicalDevice physicalDevice, VkDevice device, const VkPhysicalDeviceMemoryProperties &memoryProperties, bool memoryBudget)
+    {
+        this->physicalDevice = physicalDevice;
+        this->device = device;
+        this->memoryProperties = memoryProperties;
+        this->memoryBudget = memoryBudget;
+        pools.resize(memoryProperties.memoryTypeCount * 2);
+    }
+
+    // The heap resources with `properties` come from, or UINT32_MAX when no memory type has them.
+    uint32_t getHeapIndex(VkMemoryPropertyFlags properties)
+    {
+        uint32_t memoryType = findMemoryType(UINT32_MAX, properties);
+
+        return memoryType != UINT32_MAX ? memoryProperties.memoryTypes[memoryType].heapIndex : UINT32_MAX;
+    }
+
+    // Whether one of the memory types in `memoryTypeBits` has all of `properties`.
+    bool hasMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties)
+    {
+        return findMemoryType(memoryTypeBits, properties) != UINT32_MAX;
+    }
+
+    // Whether a resource with `requirements` could be bound to `allocation` in place of the one it was made for.
+    bool canHold(const GpuAllocation &allocation, const VkMemoryRequirements &requirements)
+    {
+        return allocation.memory != NULL && requirements.size <= allocation.size && allocation.offset % requirements.alignment == 0 &&
+               (requirements.memoryTypeBits & (1u << allocation.pool / 2)) != 0;
+    }
+
+    // Without VK_EXT_memory_budget, only this allocator's blocks count as usage, and the whole heap as budget.
+    GpuHeapBudget getHeapBudget(uint32_t heapIndex)
+    {
+        if (memoryBudget)
+        {
+            VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+            };
+
+            VkPhysicalDeviceMemoryProperties2 properties = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+                .pNext = &budgetProperties,
+            };
+
+            vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+            return {
+                .usage = budgetProperties.heapUsage[heapIndex],
+                .budget = budgetProperties.heapBudget[heapIndex],
+            };
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        GpuHeapBudget budget = {
+            .budget = memoryProperties.memoryHeaps[heapIndex].size,
+        };
+
+        for (uint32_t i = 0; i < pools.size(); i++)
+            if (memoryProperties.memoryTypes[i / 2].heapIndex == heapIndex)
+                for (const auto &block : pools[i].blocks)
+                    budget.usage += block.size;
+
+        return budget;
+    }
+
+    // Frees every block. Resources still bound to one must have been destroyed.
+    void destroy()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto &pool : pools)
+        {
+            for (auto &block : pool.blocks)
+            {
+                if (block.numAllocations > 0)
+                    printf("Freeing a device memory block with %u allocations left in it\n", block.numAllocations);
+                if (block.memory != NULL)
+                    vkFreeMemory(device, block.memory, NULL);
+            }
+
+            pool.blocks.clear();
+        }
+    }
+
+    GpuAllocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, bool optimalTiling, GpuMemoryCategory category)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+
+        if (memoryType == UINT32_MAX)
+        {
+            printf("No memory type has properties %#x\n", properties);
+            return {};
+        }
+
+        uint32_t poolIndex = memoryType * 2 + (optimalTiling ? 1 : 0);
+        Pool &pool = pools[poolIndex];
+        VkDeviceSize blockSize = getBlockSize(memoryType);
+
+        GpuAllocation allocation = {
+            .size = requirements.size,
+            .category = category,
+            .pool = poolIndex,
+            .order = BuddyRanges::getOrder(std::max(requirements.size, requirements.alignment)),
+        };
+        VkDeviceSize rangeSize = GPU_MEMORY_MIN_RANGE_SIZE << allocation.order;
+
+        if (rangeSize > blockSize / 2)
+        {
+            // The start of an allocation satisfies any alignment.
+            allocation.block = createBlock(pool, memoryType, requirements.size, true);
+            allocation.offset = 0;
+        }
+        else
+        {
+            for (uint32_t i = 0; i < pool.blocks.size() && allocation.block == UINT32_MAX; i++)
+                if (pool.blocks[i].memory != NULL && pool.blocks[i].dedicated == false && pool.blocks[i].ranges.take(allocation.order, allocation.offset))
+                    allocation.block = i;
+
+            if (allocation.block == UINT32_MAX)
+            {
+                uint32_t block = createBlock(pool, memoryType, blockSize, false);
+
+                if (block != UINT32_MAX && pool.blocks[block].ranges.take(allocation.order, allocation.offset))
+                    allocation.block = block;
+            }
+        }
+
+        if (allocation.block == UINT32_MAX)
+            return {};
+
+        Block &block = pool.blocks[allocation.block];
+        block.numAllocations++;
+        block.requestedBytes += allocation.size;
+        block.allocatedBytes += block.dedicated ? block.size : rangeSize;
+        categoryBytes[category] += block.dedicated ? block.size : rangeSize;
+
+        allocation.memory = block.memory;
+        if (block.mapped != nullptr)
+            allocation.mapped = block.mapped + allocation.offset;
+
+        return allocation;
+    }
+
+    // Returns the range to its block. Empty blocks are freed, except the last one of each pool, which is kept for the next allocation.
+    void free(GpuAllocation &allocation)
+    {
+        if (allocation.memory == NULL)
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        Pool &pool = pools[allocation.pool];
+        Block &block = pool.blocks[allocation.block];
+
+        block.numAllocations--;
+        block.requestedBytes -= allocation.size;
+        categoryBytes[allocation.category] -= block.dedicated ? block.size : GPU_MEMORY_MIN_RANGE_SIZE << allocation.order;
+
+        if (block.dedicated)
+            block.allocatedBytes = 0;
+        else
+        {
+            block.allocatedBytes -= GPU_MEMORY_MIN_RANGE_SIZE << allocation.order;
+            block.ranges.give(allocation.order, allocation.offset);
+        }
+
+        uint32_t numBlocks = (uint32_t)std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const Block &block)
+                                                     { return block.memory != NULL; });
+
+        if (block.numAllocations == 0 && (block.dedicated || numBlocks > 1))
+        {
+            vkFreeMemory(device, block.memory, NULL);
+            block = {};
+        }
+
+        allocation = {};
+    }
+
+    GpuMemoryStats getStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        GpuMemoryStats stats = {
+            .categoryBytes = categoryBytes,
+        };
+
+        for (const auto &pool : pools)
+        {
+            for (const auto &block : pool.blocks)
+            {
+                if (block.memory == NULL)
+                    continue;
+
+                stats.numBlocks++;
+                stats.numAllocations += block.numAllocations;
+                stats.blockBytes += block.size;
+                stats.requestedBytes += block.requestedBytes;
+                stats.allocatedBytes += block.allocatedBytes;
+                stats.largestFreeRange = std::max(stats.largestFreeRange, block.ranges.getLargestFreeRange());
+            }
+        }
+
+        return stats;
+    }
+
+private:
+    struct Block
+    {
+        VkDeviceMemory memory = NULL;
+        VkDeviceSize size = 0;
+        char *mapped = nullptr;
+        bool dedicated = false;
+
+        uint32_t numAllocations = 0;
+        VkDeviceSize requestedBytes = 0;
+        VkDeviceSize allocatedBytes = 0;
+
+        // Empty for dedicated blocks.
+        BuddyRanges ranges = {};
+    };
+
+    // Blocks of one memory type, either for buffers or for optimal-tiling images. Freed blocks leave an empty slot, so that allocations
+    // can keep referring to blocks by index.
+    struct Pool
+    {
+        std::vector<Block> blocks = {};
+    };
+
+    uint32_t findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties)
+    {
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+            if ((memoryTypeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+                return i;
+
+        return UINT32_MAX;
+    }
+
+    VkDeviceSize getBlockSize(uint32_t memoryType)
+    {
+        VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+
+        return std::max(std::min(GPU_MEMORY_BLOCK_SIZE, std::bit_floor(heapSize / 8)), GPU_MEMORY_MIN_RANGE_SIZE);
+    }
+
+    uint32_t createBlock(Pool &pool, uint32_t memoryType, VkDeviceSize size, bool dedicated)
+    {
+        VkMemoryAllocateInfo memoryAllocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = size,
+            .memoryTypeIndex = memoryType,
+        };
+
+        Block block = {
+            .size = size,
+            .dedicated = dedicated,
+        };
+
+        if (vkAllocateMemory(device, &memoryAllocateInfo, NULL, &block.memory) != VK_SUCCESS)
+        {
+            printf("Failed to allocate %llu bytes of device memory\n", (unsigned long long)size);
+            return UINT32_MAX;
+        }
+
+        if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+            vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, NULL, (void **)&block.mapped);
+
+        if (dedicated == false)
+            block.ranges = BuddyRanges(size);
+
+        auto emptySlot = std::find_if(pool.blocks.begin(), pool.blocks.end(), [](const Block &block)
+                                      { return block.memory == NULL; });
+
+        if (emptySlot != pool.blocks.end())
+        {
+            *emptySlot = std::move(block);
+            return (uint32_t)(emptySlot - pool.blocks.begin());
+        }
+
+        pool.blocks.push_back(std::move(block));
+
+        return (uint32_t)pool.blocks.size() - 1;
+    }
+
+    VkPhysicalDevice physicalDevice = NULL;
+    VkDevice device = NULL;
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+    bool memoryBudget = false;
+    std::vector<Pool> pools = {};
+    std::array<VkDeviceSize, GPU_MEMORY_CATEGORY_COUNT> categoryBytes = {};
+    std::mutex mutex = {};
+};
+
+// MARK: Staging ring
+
+// Hands out ranges of a persistently mapped staging buffer, used as a ring: allocations are bumped off the head, and the tail catches up
+// with a frame's allocations once the frame has finished. `allocate` is lock-free, so any thread recording into the current frame may
+// call it; `endFrame` and `releaseFrame` belong to the render thread.
+class StagingRing
+{
+public:
+    void initialize(VkBuffer buffer, void *mapped, VkDeviceSize capacity)
+    {
+        this->buffer = buffer;
+        this->mapped = (char *)mapped;
+        this->capacity = capacity;
+    }
+
+    VkBuffer getBuffer() const
+    {
+        return buffer;
+    }
+
+    // Takes `size` bytes at an `alignment` dividing the capacity, or fails when they would overwrite what a frame in flight still reads.
+    bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset, void *&data)
+    {
+        // Head and tail count bytes since the start rather than wrapping, so that a full ring and an empty one differ.
+        VkDeviceSize start = 0;
+        VkDeviceSize end = 0;
+        VkDeviceSize oldHead = head.load(std::memory_order_relaxed);
+
+        do
+        {
+            start = alignUp(oldHead, alignment);
+
+            // Ranges never wrap around, so one that would is started at the beginning of the next lap instead.
+            if (start % capacity + size > capacity)
+                start = alignUp(start, capacity);
+
+            end = start + size;
+
+            if (end - tail.load(std::memory_order_acquire) > capacity)
+                return false;
+        } while (head.compare_exchange_weak(oldHead, end, std::memory_order_relaxed) == false);
+
+        offset = start % capacity;
+        data = mapped + offset;
+
+        return true;
+    }
+
+    // Marks everything allocated so far as read by the frame that is about to be submitted.
+    void endFrame(uint32_t frameIndex)
+    {
+        frameEnds[frameIndex] = head.load(std::memory_order_relaxed);
+    }
+
+    // Frees what `frameIndex` read. Frames finish in submission order, so the tail only moves forward.
+    void releaseFrame(uint32_t frameIndex)
+    {
+        tail.store(std::max(tail.load(std::memory_order_relaxed), frameEnds[frameIndex]), std::memory_order_release);
+    }
+
+private:
+    VkBuffer buffer = NULL;
+    char *mapped = nullptr;
+    VkDeviceSize capacity = 0;
+
+    std::atomic<VkDeviceSize> head = 0;
+    std::atomic<VkDeviceSize> tail = 0;
+    std::array<VkDeviceSize, MAX_FRAMES_IN_FLIGHT> frameEnds = {};
+};
+
+// MARK: Barrier tracker
+
+// Accesses that write, and so have to be made available before anything else touches what they wrote.
+const VkAccessFlags2 WRITE_ACCESS_MASK = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+                                        VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT |
+                                        VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+// How a resource is used: the stages and accesses, and for images the layout.
+struct ResourceState
+{
+    VkPipelineStageFlags2 stageMask = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 accessMask = VK_ACCESS_2_NONE;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+// Tracks how images and buffers were last used on a queue and turns each new use into the barrier it needs, if any: writes wait for
+// everything before them, and reads wait for the last write unless an earlier barrier already made it visible to them. Barriers are
+// queued until `flush`, which records them in one vkCmdPipelineBarrier2, with every buffer's merged into a single memory barrier.
+//
+// Image states carry over from one command buffer to the next, as long as they are submitted in the order they are recorded. Buffer
+// states only last until `resetBuffers`, so every write must be flushed to its reads within the same command buffer.
+class BarrierTracker
+{
+public:
+    // Sets what `image` was last used as outside of the tracked command buffers, e.g. the semaphore wait a swapchain image was acquired
+    // with.
+    void setImageState(VkImage image, const ResourceState &state)
+    {
+        imageStates[image] = {
+            .writeStageMask = state.stageMask,
+            .writeAccessMask = state.accessMask & WRITE_ACCESS_MASK,
+            .layout = state.layout,
+        };
+    }
+
+    // Makes the next use of `image` also wait for everything `previous` was used for, as the two share memory.
+    void aliasImage(VkImage image, VkImage previous)
+    {
+        TrackedState &tracked = imageStates[image];
+        const TrackedState &aliased = imageStates[previous];
+
+        tracked.writeStageMask |= aliased.writeStageMask | aliased.readStageMask;
+        tracked.writeAccessMask |= aliased.writeAccessMask;
+    }
+
+    // Queues the barrier for `image` to be used as `state`. With `discard`, its contents are not kept, which spares the layout transition.
+    void useImage(VkImage image, VkImageAspectFlags aspectMask, const ResourceState &state, bool discard)
+    {
+        TrackedState &tracked = imageStates[image];
+        VkImageLayout oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : tracked.layout;
+        VkPipelineStageFlags2 srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 srcAccessMask = VK_ACCESS_2_NONE;
+
+        // A layout transition is a write, which everything before it waits for.
+        bool transition = oldLayout != state.layout;
+        bool barrier = use(tracked, transition, state, srcStageMask, srcAccessMask);
+
+        if (barrier == false && transition == false)
+            return;
+
+        tracked.layout = state.layout;
+
+        imageBarriers.push_back({
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = srcStageMask,
+            .srcAccessMask = srcAccessMask,
+            .dstStageMask = state.stageMask,
+            .dstAccessMask = state.accessMask,
+            .oldLayout = oldLayout,
+            .newLayout = state.layout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = image,
+            .subresourceRange = {
+                .aspectMask = aspectMask,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        });
+    }
+
+    // Queues what `buffer` needs to be accessed with `accessMask` in `stageMask`.
+    void useBuffer(VkBuffer buffer, VkPipelineStageFlags2 stageMask, VkAccessFlags2 accessMask)
+    {
+        VkPipelineStageFlags2 srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 srcAccessMask = VK_ACCESS_2_NONE;
+
+        if (use(bufferStates[buffer], false, {.stageMask = stageMask, .accessMask = accessMask}, srcStageMask, srcAccessMask) == false)
+            return;
+
+        memoryBarrier.srcStageMask |= srcStageMask;
+        memoryBarrier.srcAccessMask |= srcAccessMask;
+        memoryBarrier.dstStageMask |= stageMask;
+        memoryBarrier.dstAccessMask |= accessMask;
+    }
+
+    // Queues a barrier the tracker cannot derive, such as a queue family ownership transfer.
+    void addBufferBarrier(const VkBufferMemoryBarrier2 &barrier)
+    {
+        bufferBarriers.push_back(barrier);
+    }
+
+    void flush(VkCommandBuffer commandBuffer)
+    {
+        bool memory = memoryBarrier.dstStageMask != VK_PIPELINE_STAGE_2_NONE;
+
+        if (memory == false && bufferBarriers.empty() && imageBarriers.empty())
+            return;
+
+        VkDependencyInfo dependencyInfo = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = memory ? 1u : 0u,
+            .pMemoryBarriers = &memoryBarrier,
+            .bufferMemoryBarrierCount = (uint32_t)bufferBarriers.size(),
+            .pBufferMemoryBarriers = bufferBarriers.data(),
+            .imageMemoryBarrierCount = (uint32_t)imageBarriers.size(),
+            .pImageMemoryBarriers = imageBarriers.data(),
+        };
+
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+        memoryBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        };
+        bufferBarriers.clear();
+        imageBarriers.clear();
+    }
+
+    void resetBuffers()
+    {
+        bufferStates.clear();
+    }
+
+    // For when the tracked images are destroyed, as their handles may be reused.
+    void resetImages()
+    {
+        imageStates.clear();
+    }
+
+private:
+    // The last write, and the reads since that have waited for it.
+    struct TrackedState
+    {
+        VkPipelineStageFlags2 writeStageMask = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 writeAccessMask = VK_ACCESS_2_NONE;
+        VkPipelineStageFlags2 readStageMask = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 readAccessMask = VK_ACCESS_2_NONE;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    // Moves `tracked` on to `state`, a write if it writes or comes with a layout transition. Returns whether that needs a barrier, and
+    // from what.
+    static bool use(TrackedState &tracked, bool transition, const ResourceState &state, VkPipelineStageFlags2 &srcStageMask, VkAccessFlags2 &srcAccessMask)
+    {
+        bool writes = (state.accessMask & WRITE_ACCESS_MASK) != 0;
+
+        if (writes || transition)
+        {
+            srcStageMask = tracked.writeStageMask | tracked.readStageMask;
+            srcAccessMask = tracked.writeAccessMask;
+
+            // A transition to a read-only use is already visible to that use, through the barrier that makes it.
+            tracked = {
+                .writeStageMask = state.stageMask,
+                .writeAccessMask = state.accessMask & WRITE_ACCESS_MASK,
+                .readStageMask = writes ? VK_PIPELINE_STAGE_2_NONE : state.stageMask,
+                .readAccessMask = writes ? VK_ACCESS_2_NONE : state.accessMask,
+                .layout = tracked.layout,
+            };
+
+            return srcStageMask != VK_PIPELINE_STAGE_2_NONE;
+        }
+
+        bool visible = (tracked.readStageMask & state.stageMask) == state.stageMask && (tracked.readAccessMask & state.accessMask) == state.accessMask;
+
+        tracked.readStageMask |= state.stageMask;
+        tracked.readAccessMask |= state.accessMask;
+
+        if (tracked.writeStageMask == VK_PIPELINE_STAGE_2_NONE || visible)
+            return false;
+
+        srcStageMask = tracked.writeStageMask;
+        srcAccessMask = tracked.writeAccessMask;
+
+        return true;
+    }
+
+    std::unordered_map<VkImage, TrackedState> imageStates = {};
+    std::unordered_map<VkBuffer, TrackedState> bufferStates = {};
+
+    VkMemoryBarrier2 memoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+    };
+    std::vector<VkBufferMemoryBarrier2> bufferBarriers = {};
+    std::vector<VkImageMemoryBarrier2> imageBarriers = {};
+};
+
+// MARK: Render graph
+
+// The passes of a frame and the images and buffers each reads and writes, from which the barriers between them are derived. Passes
+// that write nothing a later kept pass or an output needs are culled. Images are declared once and their handles set every frame;
+// transient ones are only alive from the first to the last pass that uses them, as declared, and may share memory with transient
+// images whose lifetimes do not overlap. Passes are declared anew every frame, in the order they run.
+class RenderGraph
+{
+public:
+    uint32_t addImage(VkImageAspectFlags aspectMask, bool transient)
+    {
+        images.push_back({
+            .aspectMask = aspectMask,
+            .transient = transient,
+        });
+
+        return (uint32_t)images.size() - 1;
+    }
+
+    void setImage(uint32_t image, VkImage handle)
+    {
+        images[image].handle = handle;
+    }
+
+    // Forgets the passes and outputs, keeping the images.
+    void clear()
+    {
+        passes.clear();
+        outputs.clear();
+    }
+
+    // `record` records the pass's commands when the graph is executed.
+    uint32_t addPass(std::function<void(VkCommandBuffer)> &&record)
+    {
+        passes.push_back({
+            .record = std::move(record),
+        });
+
+        return (uint32_t)passes.size() - 1;
+    }
+
+    // With `discard`, the pass overwrites the whole image without reading what was there.
+    void useImage(uint32_t pass, uint32_t image, const ResourceState &state, bool discard)
+    {
+        passes[pass].imageUses.push_back({
+            .image = image,
+            .state = state,
+            .discard = discard,
+        });
+    }
+
+    // Writes that do not read are taken to overwrite the whole buffer.
+    void useBuffer(uint32_t pass, VkBuffer buffer, VkPipelineStageFlags2 stageMask, VkAccessFlags2 accessMask)
+    {
+        passes[pass].bufferUses.push_back({
+            .buffer = buffer,
+            .stageMask = stageMask,
+            .accessMask = accessMask,
+        });
+    }
+
+    // Keeps the passes writing `image`, and leaves it as `state` once the frame is done, e.g. for present.
+    void addOutput(uint32_t image, const ResourceState &state)
+    {
+        outputs.push_back({
+            .image = image,
+            .state = state,
+        });
+    }
+
+    // Culls the passes nothing needs, walking back from the outputs, and finds the lifetimes of the transient images.
+    void compile()
+    {
+        std::vector<bool> neededImages(images.size(), false);
+        std::set<VkBuffer> neededBuffers = {};
+
+        for (const auto &output : outputs)
+            neededImages[output.image] = true;
+
+        for (uint32_t i = (uint32_t)passes.size(); i-- > 0;)
+        {
+            Pass &pass = passes[i];
+
+            pass.kept = std::any_of(pass.imageUses.begin(), pass.imageUses.end(), [&](const ImageUse &use)
+                                    { return (use.state.accessMask & WRITE_ACCESS_MASK) != 0 && neededImages[use.image]; }) ||
+                        std::any_of(pass.bufferUses.begin(), pass.bufferUses.end(), [&](const BufferUse &use)
+                                    { return (use.accessMask & WRITE_ACCESS_MASK) != 0 && neededBuffers.contains(use.buffer); });
+
+            if (pass.kept == false)
+                continue;
+
+            // What the pass overwrites is not needed from passes before it; what it reads is.
+            for (const auto &use : pass.imageUses)
+                neededImages[use.image] = use.discard == false;
+
+            for (const auto &use : pass.bufferUses)
+            {
+                if ((use.accessMask & ~WRITE_ACCESS_MASK) != 0)
+                    neededBuffers.insert(use.buffer);
+                else
+                    neededBuffers.erase(use.buffer);
+            }
+        }
+
+        for (auto &image : images)
+        {
+            image.firstPass = UINT32_MAX;
+            image.lastPass = 0;
+        }
+
+        for (uint32_t i = 0; i < passes.size(); i++)
+        {
+            for (const auto &use : passes[i].imageUses)
+            {
+                images[use.image].firstPass = std::min(images[use.image].firstPass, i);
+                images[use.image].lastPass = std::max(images[use.image].lastPass, i);
+            }
+        }
+    }
+
+    // The span of passes a transient image is alive for, kept or not, so that it does not change with what is culled.
+    uint32_t getFirstPass(uint32_t image) const
+    {
+        return images[image].firstPass;
+    }
+
+    uint32_t getLastPass(uint32_t image) const
+    {
+        return images[image].lastPass;
+    }
+
+    // Records the kept passes, each after the barriers it needs. `barriers` may already hold barriers queued for the first pass.
+    void execute(VkCommandBuffer commandBuffer, BarrierTracker &barriers)
+    {
+        for (uint32_t i = 0; i < passes.size(); i++)
+        {
+            const Pass &pass = passes[i];
+
+            if (pass.kept == false)
+                continue;
+
+            for (const auto &use : pass.imageUses)
+            {
+                const Image &image = images[use.image];
+
+                // A transient image starts out in memory that images which are no longer alive may have used.
+                if (image.transient && image.firstPass == i)
+                    for (const auto &other : images)
+                        if (other.transient && other.lastPass < i)
+                            barriers.aliasImage(image.handle, other.handle);
+
+                barriers.useImage(image.handle, image.aspectMask, use.state, use.discard);
+            }
+
+            for (const auto &use : pass.bufferUses)
+                barriers.useBuffer(use.buffer, use.stageMask, use.accessMask);
+
+            barriers.flush(commandBuffer);
+            pass.record(commandBuffer);
+        }
+
+        for (const auto &output : outputs)
+            barriers.useImage(images[output.image].handle, images[output.image].aspectMask, output.state, false);
+
+        barriers.flush(commandBuffer);
+    }
+
+private:
+    struct Image
+    {
+        VkImageAspectFlags aspectMask = 0;
+        bool transient = false;
+        VkImage handle = NULL;
+        uint32_t firstPass = UINT32_MAX;
+        uint32_t lastPass = 0;
+    };
+
+    struct ImageUse
+    {
+        uint32_t image = 0;
+        ResourceState state = {};
+        bool discard = false;
+    };
+
+    struct BufferUse
+    {
+        VkBuffer buffer = NULL;
+        VkPipelineStageFlags2 stageMask = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 accessMask = VK_ACCESS_2_NONE;
+    };
+
+    struct Pass
+    {
+        std::function<void(VkCommandBuffer)> record = {};
+        std::vector<ImageUse> imageUses = {};
+        std::vector<BufferUse> bufferUses = {};
+        bool kept = false;
+    };
+
+    struct Output
+    {
+        uint32_t image = 0;
+        ResourceState state = {};
+    };
+
+    std::vector<Image> images = {};
+    std::vector<Pass> passes = {};
+    std::vector<Output> outputs = {};
+};
+
+// MARK: Transient attachments
+
+// An attachment whose contents only live within a frame: written first by pass `firstPass`, last read by pass `lastPass`, and never
+// stored.
+struct TransientAttachment
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkImageUsageFlags usage = 0;
+    VkImageAspectFlags aspectMask = 0;
+    uint32_t firstPass = 0;
+    uint32_t lastPass = 0;
+
+    VkImage image = NULL;
+    VkImageView view = NULL;
+    // Where the image is bound within the attachments' allocation.
+    VkDeviceSize offset = 0;
+};
 
-// TODO: Make the loader work for all possible variations of the data and extract all the data. There are debug `printf` that are commented out in case this misbehaves.
-struct Obj
+// Creates the transient attachments at the swapchain's extent, all bound to one allocation. Attachments whose passes do not overlap
+// alias the same memory, and the memory is lazily allocated where the device has such a type, so that tilers need not back it at all.
+// Images are recreated on resize, but the allocation is kept for as long as they still fit in it.
+class TransientAttachments
 {
-    alignas(16) float *vertexData = nullptr;
-    alignas(16) unsigned *indexData = nullptr;
-    unsigned vertexDataSize = 0;
-    unsigned indexDataSize = 0;
-    unsigned numIndices = 0;
+public:
+    void initialize(VkDevice device, GpuMemoryAllocator *memoryAllocator)
+    {
+        this->device = device;
+        this->memoryAllocator = memoryAllocator;
+    }
 
-    ~Obj()
+    // Returns the attachment's index. Takes effect on the next `create`.
+    uint32_t add(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspectMask, uint32_t firstPass, uint32_t lastPass)
     {
-        if (vertexData != nullptr)
-            free(vertexData);
-        if (indexData != nullptr)
-            free(indexData);
+        attachments.push_back({
+            .format = format,
+            .usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+            .aspectMask = aspectMask,
+            .firstPass = firstPass,
+            .lastPass = lastPass,
+        });
+
+        return (uint32_t)attachments.size() - 1;
     }
 
-    // TODO: Chunked reads.
-    Obj(const char *filename)
+    const TransientAttachment &get(uint32_t index) const
     {
-        FILE *file = fopen(filename, "rb");
-        fseek(file, 0, SEEK_END);
-        size_t size = ftell(file);
-        fseek(file, 0, SEEK_SET);
-        char *buffer = (char *)malloc(size);
-        fread(buffer, 1, size, file);
-        fclose(file);
+        return attachments[index];
+    }
+
+    // Creates every attachment at `extent`, replacing the previous images. The device must be done with those.
+    void create(VkExtent2D extent)
+    {
+        destroyImages();
 
-        unsigned numVertexLines = 0;
-        unsigned numIndexLines = 0;
+        if (attachments.empty())
+            return;
 
-        unsigned offset = 0;
+        VkMemoryRequirements requirements = {
+            .size = 0,
+            .alignment = 1,
+            .memoryTypeBits = UINT32_MAX,
+        };
+        std::vector<VkDeviceSize> sizes(attachments.size());
 
-        while (offset < size)
+        for (uint32_t i = 0; i < attachments.size(); i++)
         {
-            if (strncmp("v", buffer + offset, 1) == 0)
-            {
-                numVertexLines++;
-            }
-            else if (strncmp("f", buffer + offset, 1) == 0)
-            {
-                numIndexLines++;
-            }
+            VkImageCreateInfo imageInfo = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                .imageType = VK_IMAGE_TYPE_2D,
+                .format = attachments[i].format,
+                .extent = {extent.width, extent.height, 1},
+                .mipLevels = 1,
+                .arrayLayers = 1,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .tiling = VK_IMAGE_TILING_OPTIMAL,
+                .usage = attachments[i].usage,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            };
 
-            // Skip until seeing a newline.
-            while (buffer[offset] != '\n')
-            {
-                offset++;
-            }
-            // Then skip the newline.
-            offset++;
+            vkCreateImage(device, &imageInfo, NULL, &attachments[i].image);
+
+            VkMemoryRequirements imageRequirements = {};
+            vkGetImageMemoryRequirements(device, attachments[i].image, &imageRequirements);
+
+            sizes[i] = imageRequirements.size;
+            requirements.alignment = std::max(requirements.alignment, imageRequirements.alignment);
+            requirements.memoryTypeBits &= imageRequirements.memoryTypeBits;
         }
 
-        vertexDataSize = sizeof(float) * numVertexLines * 4;
-        indexDataSize = sizeof(unsigned) * numIndexLines * 3;
-        numIndices = numIndexLines * 3;
+        // Largest first, each at the lowest offset clear of every attachment already placed that is alive at the same time.
+        std::vector<uint32_t> order = {};
 
-        // To satisfy std430 requirements for `vec3`s.
-        vertexData = (float *)malloc(vertexDataSize);
-        indexData = (unsigned *)malloc(indexDataSize);
+        for (uint32_t i = 0; i < attachments.size(); i++)
+            order.push_back(i);
 
-        offset = 0;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+                  { return sizes[a] > sizes[b]; });
 
-        unsigned vertexDataIndex = 0;
-        unsigned indexDataIndex = 0;
+        VkDeviceSize unaliasedSize = 0;
 
-        while (offset < size)
+        for (uint32_t i = 0; i < order.size(); i++)
         {
-            if (strncmp("v", buffer + offset, 1) == 0)
+            TransientAttachment &attachment = attachments[order[i]];
+            VkDeviceSize size = sizes[order[i]];
+            bool moved = true;
+
+            attachment.offset = 0;
+
+            while (moved)
             {
-                offset += 2;
+                moved = false;
 
-                for (int i = 0; i < 3; i++)
+                for (uint32_t j = 0; j < i; j++)
                 {
-                    bool positive = buffer[offset] != '-';
+                    const TransientAttachment &other = attachments[order[j]];
+                    VkDeviceSize otherEnd = other.offset + sizes[order[j]];
+
+                    bool alive = attachment.firstPass <= other.lastPass && other.firstPass <= attachment.lastPass;
+                    bool overlapping = attachment.offset < otherEnd && other.offset < attachment.offset + size;
 
-                    if (positive != true)
+                    if (alive && overlapping)
                     {
-                        offset++;
+                        attachment.offset = alignUp(otherEnd, requirements.alignment);
+                        moved = true;
                     }
+                }
+            }
 
-                    unsigned integralPart = buffer[offset] - '0';
-                    offset += 2; // Skip decimal point as well.
+            requirements.size = std::max(requirements.size, attachment.offset + size);
+            unaliasedSize += alignUp(size, requirements.alignment);
+        }
 
-                    unsigned fractionalPart = 0; // As an integer.
-                    unsigned multiplier = 1000000;
-                    for (int j = 0; j < 7; j++)
-                    {
-                        fractionalPart += (buffer[offset] - '0') * multiplier;
-                        multiplier /= 10;
+        if (memoryAllocator->canHold(allocation, requirements) == false)
+        {
+            memoryAllocator->free(allocation);
 
-                        offset++;
-                    }
+            VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 
-                    offset++; // Skip exponent symbol.
+            if (memoryAllocator->hasMemoryType(requirements.memoryTypeBits, properties | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT))
+                properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
 
-                    bool positiveExponent = buffer[offset] != '-';
+            allocation = memoryAllocator->allocate(requirements, properties, true, GPU_MEMORY_ATTACHMENTS);
 
-                    if (positiveExponent != true)
-                    {
-                        offset++;
-                    }
+            printf("Transient attachments: %zu images in %.1f MiB, %.1f MiB saved by aliasing%s\n", attachments.size(), requirements.size / 1048576.0,
+                   (unaliasedSize - requirements.size) / 1048576.0, properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT ? ", lazily allocated" : "");
+        }
 
-                    unsigned exponent = 0;
-                    unsigned exponentMultiplier = 100;
-                    for (int j = 0; j < 3; j++)
-                    {
-                        exponent += (buffer[offset] - '0') * exponentMultiplier;
-                        exponentMultiplier /= 10;
+        for (auto &attachment : attachments)
+        {
+            vkBindImageMemory(device, attachment.image, allocation.memory, allocation.offset + attachment.offset);
+
+            VkImageViewCreateInfo viewInfo = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                .image = attachment.image,
+                .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                .format = attachment.format,
+                .subresourceRange = {
+                    .aspectMask = attachment.aspectMask,
+                    .baseMipLevel = 0,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+            };
 
-                        offset++;
-                    }
+            vkCreateImageView(device, &viewInfo, NULL, &attachment.view);
+        }
+    }
 
-                    offset++; // Skip space/newline.
+    // Keeps the allocation for the next `create`.
+    void destroyImages()
+    {
+        for (auto &attachment : attachments)
+        {
+            if (attachment.view != NULL)
+                vkDestroyImageView(device, attachment.view, NULL);
+            if (attachment.image != NULL)
+                vkDestroyImage(device, attachment.image, NULL);
 
-                    float normaliser = 1.0f;
-                    for (int j = 0; j < exponent; j++)
-                    {
-                        if (positiveExponent)
-                        {
-                            normaliser *= 10.0f;
-                        }
-                        else
-                        {
-                            normaliser /= 10.0f;
-                        }
-                    }
+            attachment.view = NULL;
+            attachment.image = NULL;
+        }
+    }
+
+    void destroy()
+    {
+        destroyImages();
+        memoryAllocator->free(allocation);
+    }
+
+private:
+    VkDevice device = NULL;
+    GpuMemoryAllocator *memoryAllocator = nullptr;
+    std::vector<TransientAttachment> attachments = {};
+    GpuAllocation allocation = {};
+};
 
-                    float result = ((float)integralPart + (fractionalPart / 10000000.0f)) * normaliser * (positive ? 1.0f : -1.0f);
+// MARK: Frame scheduler
 
-                    vertexData[vertexDataIndex * 4 + i] = result;
-                }
+// Paces the frames in flight on the graphics queue with a timeline semaphore, which each frame's submission signals with the frame's
+// number counting from 1. Frames take turns over `framesInFlight` sets of resources, so a frame first waits for the value of the one that
+// used its set before it.
+class FrameScheduler
+{
+public:
+    bool initialize(VkDevice device, uint32_t framesInFlight)
+    {
+        this->device = device;
+        this->framesInFlight = framesInFlight;
 
-                // printf("v %f %f %f\n", vertexData[vertexDataIndex * 4 + 0], vertexData[vertexDataIndex * 4 + 1], vertexData[vertexDataIndex * 4 + 2]);
+        VkSemaphoreTypeCreateInfo timelineTypeInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0,
+        };
 
-                vertexDataIndex++;
-            }
-            else if (strncmp("f", buffer + offset, 1) == 0)
+        VkSemaphoreCreateInfo timelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &timelineTypeInfo,
+        };
+
+        return vkCreateSemaphore(device, &timelineInfo, NULL, &timeline) == VK_SUCCESS;
+    }
+
+    void destroy()
+    {
+        if (timeline != NULL)
+            vkDestroySemaphore(device, timeline, NULL);
+
+        timeline = NULL;
+    }
+
+    // Frames begun so far, not counting the current one.
+    uint64_t getFrameNumber() const
+    {
+        return frameNumber;
+    }
+
+    // The set of per-frame resources the current frame uses.
+    uint32_t getFrameIndex() const
+    {
+        return (uint32_t)(frameNumber % framesInFlight);
+    }
+
+    VkSemaphore getTimeline() const
+    {
+        return timeline;
+    }
+
+    // What the current frame's submission signals the timeline with.
+    uint64_t getSignalValue() const
+    {
+        return frameNumber + 1;
+    }
+
+    // Waits for the frame that last used the current frame's resources to finish on the GPU, and returns their index.
+    uint32_t beginFrame()
+    {
+        if (frameNumber >= framesInFlight)
+        {
+            uint64_t value = frameNumber + 1 - framesInFlight;
+
+            VkSemaphoreWaitInfo waitInfo = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                .semaphoreCount = 1,
+                .pSemaphores = &timeline,
+                .pValues = &value,
+            };
+
+            vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+        }
+
+        return getFrameIndex();
+    }
+
+    // Moves on to the next frame. Every frame begun must have been submitted, signaling `getSignalValue`, by then.
+    void endFrame()
+    {
+        frameNumber++;
+    }
+
+private:
+    VkDevice device = NULL;
+    VkSemaphore timeline = NULL;
+    uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+    uint64_t frameNumber = 0;
+};
+
+// MARK: Frame pacing
+
+// Decides when each frame starts. With VK_KHR_present_wait, each frame waits for the one before it to reach the display, which keeps
+// at most one frame queued ahead of it; with a target frame time, the frame then starts as long before its present is due as frames have
+// lately taken from their start to their present. Without present wait, frames are started a target frame time apart instead, and
+// nothing holds them back otherwise. Either way, frames start at least a minimum frame time apart.
+class FramePacer
+{
+public:
+    void initialize(VkDevice device, bool presentWaitSupported, double targetFrameTime, double minFrameTime, bool lowLatency)
+    {
+        this->device = device;
+        this->targetFrameTime = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(targetFrameTime));
+        this->minFrameTime = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(minFrameTime));
+        this->lowLatency = lowLatency;
+
+        if (presentWaitSupported)
+            waitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+    }
+
+    // Present ids count anew for every swapchain.
+    void setSwapchain(VkSwapchainKHR swapchain)
+    {
+        this->swapchain = swapchain;
+        presentId = 0;
+    }
+
+    // Blocks until the next frame should start. Sleeps rather than spins, so the wait costs no CPU time.
+    void waitForFrame()
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto nextFrameStart = frameStart + targetFrameTime;
+
+        if (waitForPresent != nullptr && presentId > 0 && (lowLatency || targetFrameTime.count() > 0))
+        {
+            if (waitForPresent(device, swapchain, presentId, PRESENT_WAIT_TIMEOUT_NS) == VK_SUCCESS)
             {
-                offset += 2; // Skips 'f '.
+                now = std::chrono::steady_clock::now();
 
-                for (int i = 0; i < 3; i++)
-                {
-                    unsigned digitCount = 0;
-                    unsigned digits[8] = {};
+                // Latency drops to a faster frame at once but only creeps up after a slower one, so a single hitch does not make every
+                // later frame start early.
+                auto latency = now - frameStart;
+                frameLatency = latency < frameLatency ? latency : frameLatency + (latency - frameLatency) / 8;
+                nextFrameStart = now + targetFrameTime - frameLatency;
+            }
+        }
 
-                    while (buffer[offset] <= '9' && buffer[offset] >= '0')
-                    {
-                        digits[digitCount] = buffer[offset] - '0';
+        nextFrameStart = std::max(nextFrameStart, frameStart + minFrameTime);
 
-                        offset++; // Skips digits only.
-                        digitCount++;
-                    }
+        if (nextFrameStart > now)
+            std::this_thread::sleep_until(nextFrameStart);
 
-                    // Additional CRLF check due to Stanford bunny using it on index lines but not vertex lines.
-                    while (buffer[offset] == ' ' || buffer[offset] == 0x0A || buffer[offset] == 0x0D)
-                        offset++; // Skips space or newline.
+        frameStart = std::chrono::steady_clock::now();
+    }
 
-                    unsigned result = 0;
-                    unsigned multiplier = 1;
+    // The id to present the current frame with, or 0 if presents are not waited for.
+    uint64_t getPresentId()
+    {
+        return waitForPresent != nullptr ? ++presentId : 0;
+    }
 
-                    for (int j = 0; j < digitCount; j++)
-                    {
-                        result += digits[digitCount - 1 - j] * multiplier;
+private:
+    VkDevice device = NULL;
+    VkSwapchainKHR swapchain = NULL;
+    PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+    std::chrono::steady_clock::duration targetFrameTime = {};
+    std::chrono::steady_clock::duration minFrameTime = {};
+    bool lowLatency = false;
+
+    uint64_t presentId = 0;
+    std::chrono::steady_clock::time_point frameStart = {};
+    // How long frames lately took from their start to reaching the display.
+    std::chrono::steady_clock::duration frameLatency = {};
+};
 
-                        multiplier *= 10;
-                    }
+// MARK: Recording threads
 
-                    indexData[indexDataIndex * 3 + i] = result - 1;
-                }
+// Threads that are kept around for recording each frame's commands in parallel, as starting them every frame with `runOnThreads` would
+// cost more than recording does. The calling thread takes part as thread 0.
+class RecordingThreads
+{
+public:
+    ~RecordingThreads()
+    {
+        stop();
+    }
+
+    void start(unsigned numThreads)
+    {
+        for (unsigned i = 1; i < numThreads; i++)
+            workers.emplace_back([this, i]()
+                                 { runJobs(i); });
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        jobStarted.notify_all();
+
+        for (auto &worker : workers)
+            if (worker.joinable())
+                worker.join();
+
+        workers.clear();
+    }
+
+    unsigned getNumThreads() const
+    {
+        return (unsigned)workers.size() + 1;
+    }
+
+    // Calls `function(threadIndex)` on the first `numThreads` threads and returns once all of them have finished.
+    void run(unsigned numThreads, const std::function<void(unsigned)> &function)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &function;
+            jobThreads = numThreads;
+            pendingThreads = (unsigned)workers.size();
+            generation++;
+        }
+
+        jobStarted.notify_all();
+
+        function(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        jobFinished.wait(lock, [this]()
+                         { return pendingThreads == 0; });
+        job = nullptr;
+    }
+
+private:
+    void runJobs(unsigned threadIndex)
+    {
+        uint64_t finishedGeneration = 0;
+
+        while (true)
+        {
+            const std::function<void(unsigned)> *function = nullptr;
 
-                // printf("f %u %u %u\n", indexData[indexDataIndex * 3 + 0], indexData[indexDataIndex * 3 + 1], indexData[indexDataIndex * 3 + 2]);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobStarted.wait(lock, [&]()
+                                { return stopping || generation != finishedGeneration; });
+
+                if (stopping)
+                    return;
 
-                indexDataIndex++;
+                finishedGeneration = generation;
+
+                if (threadIndex < jobThreads)
+                    function = job;
             }
-            else
+
+            if (function != nullptr)
+                (*function)(threadIndex);
+
             {
-                while (buffer[offset] != '\n')
-                {
-                    offset++;
-                }
+                std::lock_guard<std::mutex> lock(mutex);
 
-                offset++;
+                if (--pendingThreads == 0)
+                    jobFinished.notify_one();
             }
         }
     }
 
-    VkVertexInputBindingDescription getBindingDescription()
+    std::vector<std::thread> workers = {};
+    std::mutex mutex = {};
+    std::condition_variable jobStarted = {};
+    std::condition_variable jobFinished = {};
+    const std::function<void(unsigned)> *job = nullptr;
+    unsigned jobThreads = 0;
+    unsigned pendingThreads = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+};
+
+// A recording thread's command pool for one frame in flight, and the secondary command buffer it records its share of draws into.
+struct FrameCommandPool
+{
+    VkCommandPool pool = NULL;
+    VkCommandBuffer secondaryCommandBuffer = NULL;
+};
+
+// MARK: Command buffer cache
+
+// Command buffers recorded once and submitted again for as long as what they record stays the same. They reference per-frame resources
+// and a swapchain image, so there is one for each frame in flight and image. Invalidating drops them all, but as the ones of other
+// frames may still be in flight, each frame's pool is only reset, as a whole, once that frame comes round again.
+class CommandBufferCache
+{
+public:
+    void initialize(VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight)
     {
-        VkVertexInputBindingDescription bindingDescription = {
-            .binding = 0,
-            .stride = sizeof(float) * 4,
-            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+        this->device = device;
+
+        VkCommandPoolCreateInfo commandPoolInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .queueFamilyIndex = queueFamilyIndex,
         };
 
-        return bindingDescription;
+        frames.resize(framesInFlight);
+
+        for (auto &frame : frames)
+            if (vkCreateCommandPool(device, &commandPoolInfo, NULL, &frame.pool) != VK_SUCCESS)
+                printf("Command buffer cache pool creation failed\n");
     }
 
-    std::array<VkVertexInputAttributeDescription, 1> getAttributeDescription()
+    void destroy()
     {
-        VkVertexInputAttributeDescription positionsDescription = {
-            .location = 0,
-            .binding = 0,
-            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
-            .offset = 0,
-        };
+        for (auto &frame : frames)
+            if (frame.pool != NULL)
+                vkDestroyCommandPool(device, frame.pool, NULL);
+
+        frames.clear();
+    }
+
+    void invalidate()
+    {
+        generation++;
+    }
+
+    // Returns the command buffer recorded for `imageIndex` in frame `frameIndex`, and whether it is still valid. If not, it has to be
+    // recorded before it is submitted. The frame's previous submission must have finished.
+    VkCommandBuffer get(uint32_t frameIndex, uint32_t imageIndex, bool &valid)
+    {
+        Frame &frame = frames[frameIndex];
+
+        if (frame.generation != generation)
+        {
+            vkResetCommandPool(device, frame.pool, 0);
+
+            for (auto &commandBuffer : frame.commandBuffers)
+                commandBuffer.valid = false;
+
+            frame.generation = generation;
+        }
+
+        if (imageIndex >= frame.commandBuffers.size())
+            frame.commandBuffers.resize(imageIndex + 1);
+
+        CachedCommandBuffer &cached = frame.commandBuffers[imageIndex];
+
+        if (cached.commandBuffer == NULL)
+        {
+            VkCommandBufferAllocateInfo commandBufferAllocInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = frame.pool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+            };
+
+            if (vkAllocateCommandBuffers(device, &commandBufferAllocInfo, &cached.commandBuffer) != VK_SUCCESS)
+                printf("Failed to allocate cached command buffer\n");
+        }
+
+        valid = cached.valid;
+        cached.valid = true;
+
+        if (valid)
+            hits++;
+        else
+            misses++;
+
+        return cached.commandBuffer;
+    }
+
+    void printStats()
+    {
+        printf("Command buffer cache: %llu hits, %llu misses, %.1f%% hit rate\n", (unsigned long long)hits, (unsigned long long)misses,
+               hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0);
+    }
+
+private:
+    struct CachedCommandBuffer
+    {
+        VkCommandBuffer commandBuffer = NULL;
+        bool valid = false;
+    };
+
+    struct Frame
+    {
+        VkCommandPool pool = NULL;
+        uint64_t generation = 0;
+        // By swapchain image.
+        std::vector<CachedCommandBuffer> commandBuffers = {};
+    };
+
+    VkDevice device = NULL;
+    std::vector<Frame> frames = {};
+    uint64_t generation = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+// MARK: Asset loader
+
+// A lock-free queue with many producers and one consumer. Producers push onto a list with a compare-and-swap; the consumer takes the
+// whole list in one exchange, which sidesteps the ABA problem of popping single nodes, and reverses it back into push order.
+template <typename T>
+class CompletionQueue
+{
+public:
+    ~CompletionQueue()
+    {
+        drain([](T &&) {});
+    }
+
+    void push(T value)
+    {
+        Node *node = new Node{std::move(value), head.load(std::memory_order_relaxed)};
+
+        while (head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed) == false)
+            ;
+    }
+
+    // Calls `function` on everything pushed so far, oldest first. Never blocks.
+    template <typename Function>
+    void drain(Function function)
+    {
+        Node *node = head.exchange(nullptr, std::memory_order_acquire);
+        Node *reversed = nullptr;
+
+        while (node != nullptr)
+        {
+            Node *next = node->next;
+            node->next = reversed;
+            reversed = node;
+            node = next;
+        }
+
+        while (reversed != nullptr)
+        {
+            Node *next = reversed->next;
+            function(std::move(reversed->value));
+            delete reversed;
+            reversed = next;
+        }
+    }
+
+private:
+    struct Node
+    {
+        T value;
+        Node *next;
+    };
+
+    std::atomic<Node *> head = nullptr;
+};
+
+// A fixed pool of threads that run jobs in the order they were queued. Jobs report back through a `CompletionQueue`, so whoever queues
+// them never waits on one.
+class AssetLoader
+{
+public:
+    AssetLoader(unsigned numThreads)
+    {
+        for (unsigned i = 0; i < numThreads; i++)
+            workers.emplace_back([this]()
+                                 { runJobs(); });
+    }
+
+    ~AssetLoader()
+    {
+        stop();
+    }
+
+    void enqueue(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+
+        jobAdded.notify_one();
+    }
 
-        std::array<VkVertexInputAttributeDescription, 1> attributeDescriptions = {
-            positionsDescription,
-        };
+    // Drops the jobs that have not started and waits for the running ones to finish.
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            jobs.clear();
+        }
 
-        return attributeDescriptions;
+        jobAdded.notify_all();
+
+        for (auto &worker : workers)
+            if (worker.joinable())
+                worker.join();
     }
-};
 
-// MARK: Renderer frontmatter
+private:
+    void runJobs()
+    {
+        while (true)
+        {
+            std::function<void()> job = nullptr;
 
-const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAdded.wait(lock, [this]()
+                              { return stopping || jobs.empty() == false; });
 
-const std::array<const char *, 1> requiredInstanceLayers = {
-    "VK_LAYER_KHRONOS_validation",
-};
+                if (stopping)
+                    return;
 
-const std::array<const char *, 3> requiredInstanceExtensions = {
-    VK_KHR_SURFACE_EXTENSION_NAME,
-    VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
-    VK_EXT_DEBUG_UTILS_EXTENSION_NAME,
-};
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
 
-const std::array<const char *, 4> requiredDeviceExtensions = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-    VK_KHR_SPIRV_1_4_EXTENSION_NAME,
-    VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME,
-    VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
-};
+            job();
+        }
+    }
 
-struct Dimensions
-{
-    uint32_t width = 0;
-    uint32_t height = 0;
+    std::vector<std::thread> workers = {};
+    std::mutex mutex = {};
+    std::condition_variable jobAdded = {};
+    std::deque<std::function<void()>> jobs = {};
+    bool stopping = false;
 };
 
-struct UniformBufferObject
+// A graphics pipeline for one vertex layout, shared by every mesh laid out like it. The stride is dynamic, so only the attributes the
+// vertex shader reads tell layouts apart.
+struct MeshPipeline
 {
-    glm::mat4 model;
-    glm::mat4 view;
-    glm::mat4 proj;
+    std::vector<VkVertexInputAttributeDescription> attributes = {};
+    VkPipeline pipeline = NULL;
 };
 
-struct Vertex
+// A mesh and everything it is drawn with. Built on a loader thread, then owned by the render thread.
+struct RenderMesh
 {
-    glm::vec3 pos;
-    glm::vec3 color;
-
-    static VkVertexInputBindingDescription getBindingDescription()
-    {
-        VkVertexInputBindingDescription bindingDescription = {
-            .binding = 0,
-            .stride = sizeof(Vertex),
-            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-        };
-
-        return bindingDescription;
-    }
-
-    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescription()
-    {
-        VkVertexInputAttributeDescription positionsDescription = {
-            .location = 0,
-            .binding = 0,
-            .format = VK_FORMAT_R32G32B32_SFLOAT,
-            .offset = offsetof(Vertex, pos),
-        };
+    std::string name = {};
+    std::unique_ptr<Obj> obj = nullptr;
+    glm::mat4 model = glm::mat4(1.0f);
+    // The renderer's pipeline for the mesh's vertex layout, found or created on the loader thread. The index orders draws by pipeline.
+    uint32_t pipelineIndex = 0;
+    VkPipeline pipeline = NULL;
 
-        VkVertexInputAttributeDescription colorsDescription = {
-            .location = 1,
-            .binding = 0,
-            .format = VK_FORMAT_R32G32B32_SFLOAT,
-            .offset = offsetof(Vertex, color),
-        };
+    // The mesh's range of a geometry page, holding its vertices, then its indices, then its meshlets. Only taken while the mesh is
+    // resident: meshes are made resident when they come into view, and evicted once they have been out of it for a while.
+    uint32_t geometryPage = UINT32_MAX;
+    VkDeviceSize geometryOffset = 0;
+    VkDeviceSize geometrySize = 0;
+    VkDeviceSize indexOffset = 0;
+    VkDeviceSize meshletOffset = 0;
+    uint64_t lastVisibleFrame = 0;
+
+    // How far copying the geometry through the staging ring has got: the part (vertices, indices, then meshlets) and the bytes of it
+    // copied so far. Once `copied`, a transfer queue releases the geometry in the submission that signals `uploadValue` on its timeline,
+    // and the graphics queue acquires it in the first frame after that. The mesh is drawn once `uploaded`.
+    uint32_t uploadPart = 0;
+    VkDeviceSize uploadPartBytes = 0;
+    bool copied = false;
+    uint64_t uploadValue = 0;
+    bool uploaded = false;
+
+    // Written every frame, so each frame in flight has its own. Uniform buffers are written through their allocation's mapping.
+    std::vector<VkBuffer> uniformBuffers = {};
+    std::vector<GpuAllocation> uniformBufferAllocations = {};
+    std::vector<VkBuffer> drawCommandBuffers = {};
+    std::vector<GpuAllocation> drawCommandBufferAllocations = {};
+    std::vector<VkBuffer> drawCountBuffers = {};
+    std::vector<GpuAllocation> drawCountBufferAllocations = {};
 
-        std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions = {
-            positionsDescription,
-            colorsDescription,
-        };
+    VkDescriptorPool descriptorPool = NULL;
+    std::vector<VkDescriptorSet> descriptorSets = {};
 
-        return attributeDescriptions;
-    }
+    // Set by `updateUniformBuffer` and used when recording the same frame.
+    uint32_t currentLod = 0;
+    bool visible = true;
 };
 
-const std::array<Vertex, 6> upperTrapezoid = {{
-    {{0.5f, -1.0f, 0.5f}, {0.0f, 0.5f, 1.0f}},
-    {{-0.5f, 0.0f, 0.5f}, {0.0f, 1.0f, 0.0f}},
-    {{-0.4f, -1.0f, 0.5f}, {1.0f, 0.5f, 0.0f}},
-    {{0.5f, -1.0f, 0.5f}, {0.0f, 0.5f, 1.0f}},
-    {{0.4f, 0.0f, 0.5f}, {1.0f, 1.0f, 1.0f}},
-    {{-0.5f, 0.0f, 0.5f}, {0.0f, 1.0f, 0.0f}},
-}};
-
 // TODO: Replace with a proper interface after factoring classes out.
 class WindowInterface
 {
@@ -395,68 +1897,60 @@ public:
     // MARK: Renderer ctor/dtor
 
     // TODO: Replace with proper interface after factoring relevant class out.
-    Renderer(WindowInterface *windowInterface) : windowInterface(windowInterface)
+    Renderer(WindowInterface *windowInterface, const RendererSettings &settings) : windowInterface(windowInterface), settings(settings)
     {
         initializeVulkan();
         initializeVulkanResources();
+
+        loadMesh("./res/bunny.obj", glm::mat4(1.0f));
     }
 
     ~Renderer()
     {
         shouldDestruct = true;
+        requestRedraw();
 
-        while (canDestruct == false)
-            ;
+        canDestruct.wait(false);
+
+        // Loads still running finish first, as they create resources on the device.
+        assetLoader.stop();
+        takeLoadedMeshes();
 
         if (device != NULL)
         {
-            if (depthImageMemory != NULL)
-                vkFreeMemory(device, depthImageMemory, NULL);
-            if (depthImage != NULL)
-                vkDestroyImage(device, depthImage, NULL);
+            for (auto &mesh : meshes)
+                destroyMeshResources(mesh);
+            destroyBuffer(stagingRingBuffer, stagingRingAllocation);
             for (auto &descriptorSetLayout : descriptorSetLayouts)
                 if (descriptorSetLayout != NULL)
                     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, NULL);
-            if (descriptorPool != NULL)
-                vkDestroyDescriptorPool(device, descriptorPool, NULL);
-            for (auto &uniformBufferMemory : uniformBuffersMemory)
-                if (uniformBufferMemory != NULL)
-                {
-                    vkUnmapMemory(device, uniformBufferMemory);
-                    vkFreeMemory(device, uniformBufferMemory, NULL);
-                }
-            for (auto &uniformBuffer : uniformBuffers)
-                if (uniformBuffer != NULL)
-                    vkDestroyBuffer(device, uniformBuffer, NULL);
-            if (vertexBuffer != NULL)
-                vkDestroyBuffer(device, vertexBuffer, NULL);
-            if (vertexBufferMemory != NULL)
-                vkFreeMemory(device, vertexBufferMemory, NULL);
-            if (indexBuffer != NULL)
-                vkDestroyBuffer(device, indexBuffer, NULL);
-            if (indexBufferMemory != NULL)
-                vkFreeMemory(device, indexBufferMemory, NULL);
-            for (auto &fence : inflightFences)
-                if (fence != NULL)
-                    vkDestroyFence(device, fence, NULL);
             for (auto &semaphore : presentCompleteSemaphores)
                 if (semaphore != NULL)
                     vkDestroySemaphore(device, semaphore, NULL);
-            for (auto &semaphore : renderFinishedSemaphores)
-                if (semaphore != NULL)
-                    vkDestroySemaphore(device, semaphore, NULL);
-            if (commandPool != NULL)
-                vkDestroyCommandPool(device, commandPool, NULL);
+            if (transferTimeline != NULL)
+                vkDestroySemaphore(device, transferTimeline, NULL);
+            frameScheduler.destroy();
+            for (auto &commandPool : frameCommandPools)
+                if (commandPool.pool != NULL)
+                    vkDestroyCommandPool(device, commandPool.pool, NULL);
+            commandBufferCache.destroy();
             if (transferCommandPool != NULL)
                 vkDestroyCommandPool(device, transferCommandPool, NULL);
-            if (pipeline != NULL)
-                vkDestroyPipeline(device, pipeline, NULL);
+            for (auto &meshPipeline : meshPipelines)
+                if (meshPipeline.pipeline != NULL)
+                    vkDestroyPipeline(device, meshPipeline.pipeline, NULL);
             if (pipelineLayout != NULL)
                 vkDestroyPipelineLayout(device, pipelineLayout, NULL);
+            if (cullPipeline != NULL)
+                vkDestroyPipeline(device, cullPipeline, NULL);
+            if (cullPipelineLayout != NULL)
+                vkDestroyPipelineLayout(device, cullPipelineLayout, NULL);
             if (shaderModule != NULL)
                 vkDestroyShaderModule(device, shaderModule, NULL);
 
             cleanupSwapchain();
+            transientAttachments.destroy();
+            memoryAllocator.destroy();
 
             vkDestroyDevice(device, NULL);
         }
@@ -476,18 +1970,103 @@ public:
 
     void mainLoop()
     {
+        uint64_t drawnRedrawRequests = 0;
+
         while (shouldDestruct == false)
         {
+            // Geometry still being uploaded, or in view but waiting on an eviction to become resident, is only finished by drawing, so
+            // frames carry on until it is.
+            bool uploading = residencyPending || std::any_of(meshes.begin(), meshes.end(), [](const RenderMesh &mesh)
+                                                             { return mesh.geometryPage != UINT32_MAX && mesh.uploaded == false; });
+
+            if (settings.renderOnDemand && uploading == false)
+                redrawRequests.wait(drawnRedrawRequests, std::memory_order_acquire);
+
+            drawnRedrawRequests = redrawRequests.load(std::memory_order_acquire);
             drawFrame();
         }
 
         vkDeviceWaitIdle(device);
 
         canDestruct = true;
+        canDestruct.notify_all();
+    }
+
+    // Wakes the render thread for another frame, when drawing on demand or while it waits for a window to draw to. Called for anything
+    // that changes what is shown; any thread may call it.
+    void requestRedraw()
+    {
+        redrawRequests.fetch_add(1, std::memory_order_release);
+        redrawRequests.notify_all();
+    }
+
+    // Parses and uploads `path` on a loader thread. The mesh is drawn from the first frame after its upload has finished, and until then
+    // the renderer carries on without it.
+    void loadMesh(const char *path, const glm::mat4 &model)
+    {
+        assetLoader.enqueue([this, name = std::string(path), model]()
+                            {
+                                // Leaves one core to the render thread and splits the rest between the loader threads.
+                                unsigned numThreads = std::max(std::thread::hardware_concurrency(), ASSET_LOADER_THREADS + 1) - 1;
+
+                                RenderMesh mesh = {
+                                    .name = name,
+                                    .obj = std::make_unique<Obj>(name.c_str(), ObjLoadInfo{.numThreads = numThreads / ASSET_LOADER_THREADS, .quantizeVertices = settings.quantizeVertices}),
+                                    .model = model,
+                                };
+
+                                // Normals are generated for any mesh with faces, so only a mesh without them lacks the vertex shader's inputs.
+                                if (mesh.obj->lods.empty() || (mesh.obj->vertexAttributes & OBJ_ATTRIBUTE_NORMAL_BIT) == 0)
+                                {
+                                    printf("Skipping %s: it has no faces\n", name.c_str());
+                                    return;
+                                }
+
+                                // Pipelines are only ever created here, so that a new vertex layout does not stall the render thread.
+                                mesh.pipelineIndex = getMeshPipeline(*mesh.obj, mesh.pipeline);
+
+                                createMeshResources(mesh);
+                                loadedMeshes.push(std::move(mesh));
+                                requestRedraw(); });
+    }
+
+    // Takes over the meshes the loader threads have finished since the last frame. Never waits on a load.
+    void takeLoadedMeshes()
+    {
+        loadedMeshes.drain([this](RenderMesh &&mesh)
+                           {
+                               printf("Showing %s\n", mesh.name.c_str());
+                               meshes.push_back(std::move(mesh));
+                               printMemoryStats(); });
+    }
+
+    void printMemoryStats()
+    {
+        GpuMemoryStats stats = memoryAllocator.getStats();
+        VkDeviceSize freeBytes = stats.blockBytes - stats.allocatedBytes;
+
+        // Fragmentation is the share of free memory outside the largest free range, so 0% means all of it could hold one resource.
+        printf("GPU memory: %u allocations in %u blocks, %.1f of %.1f MiB used, %.1f MiB lost to rounding, %.0f%% of free memory fragmented\n",
+               stats.numAllocations, stats.numBlocks, stats.allocatedBytes / 1048576.0, stats.blockBytes / 1048576.0,
+               (stats.allocatedBytes - stats.requestedBytes) / 1048576.0, freeBytes > 0 ? 100.0 * (freeBytes - stats.largestFreeRange) / freeBytes : 0.0);
+
+        printf("GPU memory by use:");
+        for (uint32_t i = 0; i < GPU_MEMORY_CATEGORY_COUNT; i++)
+            printf(" %s %.1f MiB%s", gpuMemoryCategoryNames[i], stats.categoryBytes[i] / 1048576.0, i + 1 < GPU_MEMORY_CATEGORY_COUNT ? "," : "\n");
+
+        uint32_t residentMeshes = (uint32_t)std::count_if(meshes.begin(), meshes.end(), [](const RenderMesh &mesh)
+                                                          { return mesh.geometryPage != UINT32_MAX; });
+        GpuHeapBudget budget = memoryAllocator.getHeapBudget(geometryHeapIndex);
+
+        printf("Geometry heap: %.1f of %.1f MiB budget used, %u of %zu meshes resident\n", budget.usage / 1048576.0, budget.budget / 1048576.0,
+               residentMeshes, meshes.size());
     }
 
     void handleFramebufferResize(Dimensions dimensions)
     {
+        // A window restored from being minimized can be drawn to again, even when the resize itself is ignored.
+        requestRedraw();
+
         // Ignore if the previous pending extent hasn't been picked up.
         if (framebufferResized == true)
             return;
@@ -523,10 +2102,25 @@ public:
             }
         }
 
-        numSwapchainImages = surfaceCapabilities.minImageCount + 1;
+        uint32_t presentModeCount = 0;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, NULL);
+        std::vector<VkPresentModeKHR> presentModes(presentModeCount);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, presentModes.data());
+
+        VkPresentModeKHR presentMode = settings.presentMode;
+
+        if (std::find(presentModes.begin(), presentModes.end(), presentMode) == presentModes.end())
+        {
+            printf("Present mode %d is not supported by the surface, falling back to FIFO\n", presentMode);
+            presentMode = VK_PRESENT_MODE_FIFO_KHR;
+        }
+
+        // A max image count of 0 means there is no limit.
+        numSwapchainImages = settings.swapchainImages != 0 ? settings.swapchainImages : surfaceCapabilities.minImageCount + 1;
+        numSwapchainImages = std::max(numSwapchainImages, surfaceCapabilities.minImageCount);
 
-        if (numSwapchainImages > surfaceCapabilities.maxImageCount)
-            numSwapchainImages = surfaceCapabilities.maxImageCount;
+        if (surfaceCapabilities.maxImageCount != 0)
+            numSwapchainImages = std::min(numSwapchainImages, surfaceCapabilities.maxImageCount);
 
         VkSwapchainCreateInfoKHR swapchainInfo = {
             .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
@@ -542,7 +2136,7 @@ public:
             .pQueueFamilyIndices = &graphicsQueueFamilyIndex,
             .preTransform = surfaceCapabilities.currentTransform,
             .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-            .presentMode = VK_PRESENT_MODE_FIFO_KHR,
+            .presentMode = presentMode,
             .clipped = VK_TRUE,
         };
 
@@ -555,10 +2149,16 @@ public:
         if (vkCreateSwapchainKHR(device, &swapchainInfo, NULL, &swapchain) != VK_SUCCESS)
             printf("Failed to create swapchain\n");
 
+        // The implementation may create more images than asked for.
         uint32_t imageCount = 0;
         vkGetSwapchainImagesKHR(device, swapchain, &imageCount, NULL);
         swapchainImages = std::vector<VkImage>(imageCount);
         vkGetSwapchainImagesKHR(device, swapchain, &imageCount, swapchainImages.data());
+        numSwapchainImages = imageCount;
+
+        printf("Swapchain: %u images, present mode %d\n", numSwapchainImages, presentMode);
+
+        framePacer.setSwapchain(swapchain);
 
         VkImageViewCreateInfo viewInfo = {
             .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
@@ -580,20 +2180,51 @@ public:
             viewInfo.image = swapchainImages[i];
             vkCreateImageView(device, &viewInfo, NULL, &swapchainImageViews[i]);
         }
+
+        // Present semaphores are per image, as an image's present has to have waited on its semaphore before the image is acquired again.
+
+        VkSemaphoreCreateInfo semaphoreInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        };
+
+        renderFinishedSemaphores = std::vector<VkSemaphore>(imageCount);
+
+        for (auto &semaphore : renderFinishedSemaphores)
+            if (vkCreateSemaphore(device, &semaphoreInfo, NULL, &semaphore) != VK_SUCCESS)
+                printf("Semaphore creation failed\n");
     }
 
-    void cleanupSwapchain()
+    // A minimized window has no extent to create a swapchain at, so this sleeps until the window is resized and tries again. Returns
+    // false if the renderer is destroyed first.
+    bool createSwapchainWhenVisible()
     {
-        if (depthImageView != NULL)
+        while (shouldDestruct == false)
         {
-            vkDestroyImageView(device, depthImageView, NULL);
-            depthImageView = NULL;
+            uint64_t requests = redrawRequests.load(std::memory_order_acquire);
+
+            createSwapchain();
+
+            if (swapchain != NULL)
+                return true;
+
+            redrawRequests.wait(requests, std::memory_order_acquire);
         }
+
+        return false;
+    }
+
+    void cleanupSwapchain()
+    {
         for (auto &view : swapchainImageViews)
         {
             vkDestroyImageView(device, view, NULL);
             view = NULL;
         }
+        for (auto &semaphore : renderFinishedSemaphores)
+        {
+            vkDestroySemaphore(device, semaphore, NULL);
+            semaphore = NULL;
+        }
         if (swapchain != NULL)
         {
             vkDestroySwapchainKHR(device, swapchain, NULL);
@@ -606,15 +2237,17 @@ public:
         vkDeviceWaitIdle(device);
 
         cleanupSwapchain();
-        while (swapchain == NULL)
-        {
-            createSwapchain();
-            if (shouldDestruct)
-            {
-                return;
-            }
-        }
-        createDepthResources();
+        frameBarriers.resetImages();
+
+        if (createSwapchainWhenVisible() == false)
+            return;
+
+        // Attachments are recreated at the new extent, in the memory they already have if they fit.
+        transientAttachments.create(extent);
+        commandBufferCache.invalidate();
+
+        // Nothing has been presented to the new swapchain yet.
+        requestRedraw();
     }
 
     // TODO: Use a push constant for this.
@@ -625,120 +2258,473 @@ public:
         auto now = std::chrono::high_resolution_clock::now();
         float elapsed = std::chrono::duration<float, std::chrono::seconds::period>(now - start).count();
 
-        UniformBufferObject ubo = {};
-
         glm::vec3 cameraPosition = glm::vec3(0.0f, 0.0f, 1.0f);
         glm::vec3 cameraFocus = glm::vec3(0.0f, 0.0f, 0.0f);
         glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
         cameraAngle = cameraFocus - cameraPosition;
 
         // TODO: Use the right GLM define so that angles can be input in degrees.
-        ubo.model = glm::mat4(1.0f);
-        ubo.view = glm::lookAt(cameraPosition, cameraFocus, cameraUp);
-        ubo.view = glm::rotate(ubo.view, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        ubo.proj = glm::perspective(glm::radians(45.0f), static_cast<float>(extent.width) / static_cast<float>(extent.height), 0.1f, 10.0f);
-        
-        memcpy(uniformBuffersMapped[frameIndex], &ubo, sizeof(ubo));
+        glm::mat4 view = glm::lookAt(cameraPosition, cameraFocus, cameraUp);
+        view = glm::rotate(view, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        glm::mat4 proj = glm::perspective(glm::radians(45.0f), static_cast<float>(extent.width) / static_cast<float>(extent.height), 0.1f, 10.0f);
+
+        for (auto &mesh : meshes)
+            updateMeshUniformBuffer(mesh, frameIndex, view, proj);
+    }
+
+    void updateMeshUniformBuffer(RenderMesh &mesh, uint32_t frameIndex, const glm::mat4 &view, const glm::mat4 &proj)
+    {
+        const Obj &obj = *mesh.obj;
+        UniformBufferObject ubo = {};
+
+        ubo.model = mesh.model;
+        ubo.view = view;
+        ubo.proj = proj;
+        mesh.obj->getPositionDecode(&ubo.positionScale[0], &ubo.positionOffset[0]);
+        ubo.octahedralNormals = obj.quantized;
+
+        // Extract the planes from the rows of the clip matrix (Gribb and Hartmann), for 0 to 1 depth.
+        glm::mat4 clipRows = glm::transpose(ubo.proj * ubo.view * ubo.model);
+
+        ubo.frustumPlanes[0] = clipRows[3] + clipRows[0];
+        ubo.frustumPlanes[1] = clipRows[3] - clipRows[0];
+        ubo.frustumPlanes[2] = clipRows[3] + clipRows[1];
+        ubo.frustumPlanes[3] = clipRows[3] - clipRows[1];
+        ubo.frustumPlanes[4] = clipRows[2];
+        ubo.frustumPlanes[5] = clipRows[3] - clipRows[2];
+
+        for (auto &plane : ubo.frustumPlanes)
+            plane /= glm::length(glm::vec3(plane));
+
+        // The whole mesh is skipped before any meshlet is tested when its bounding sphere is outside a plane.
+        glm::vec3 sphereCenter = glm::vec3(obj.boundingSphere[0], obj.boundingSphere[1], obj.boundingSphere[2]);
+        mesh.visible = std::all_of(std::begin(ubo.frustumPlanes), std::end(ubo.frustumPlanes), [&](const glm::vec4 &plane)
+                                   { return glm::dot(glm::vec3(plane), sphereCenter) + plane.w >= -obj.boundingSphere[3]; });
+
+        ubo.cameraPosition = glm::inverse(ubo.view * ubo.model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+        uint32_t lod = selectLod(obj, ubo.view * ubo.model, ubo.proj);
+
+        if (lod != mesh.currentLod && lod < obj.lods.size())
+            printf("%s LOD %u: %u triangles, %u meshlets\n", mesh.name.c_str(), lod, obj.lods[lod].numIndices / 3, obj.lods[lod].numMeshlets);
+
+        mesh.currentLod = lod;
+
+        if (mesh.visible && mesh.currentLod < obj.lods.size())
+        {
+            ubo.firstMeshlet = obj.lods[mesh.currentLod].firstMeshlet;
+            ubo.numMeshlets = obj.lods[mesh.currentLod].numMeshlets;
+        }
+
+        memcpy(mesh.uniformBufferAllocations[frameIndex].mapped, &ubo, sizeof(ubo));
+    }
+
+    // Picks the coarsest LOD whose error stays within `settings.lodErrorThreshold` pixels when projected at the closest point of the
+    // mesh's bounding sphere. Errors are object-space distances, so they are scaled by the model matrix's largest axis scale.
+    uint32_t selectLod(const Obj &mesh, const glm::mat4 &modelView, const glm::mat4 &proj)
+    {
+        float scale = std::max({glm::length(glm::vec3(modelView[0])), glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2]))});
+        float radius = mesh.boundingSphere[3] * scale;
+        glm::vec4 center = modelView * glm::vec4(mesh.boundingSphere[0], mesh.boundingSphere[1], mesh.boundingSphere[2], 1.0f);
+
+        // Inside the sphere the closest point is at the near plane at best; 0.1 matches the projection's near plane.
+        float distance = std::max(glm::length(glm::vec3(center)) - radius, 0.1f);
+        float pixelsPerUnit = proj[1][1] * extent.height * 0.5f / distance;
+
+        for (uint32_t lod = (uint32_t)mesh.lods.size(); lod-- > 1;)
+            if (mesh.lods[lod].error * scale * pixelsPerUnit <= settings.lodErrorThreshold)
+                return lod;
+
+        return 0;
     }
 
     void drawFrame()
     {
-        while (vkWaitForFences(device, 1, &inflightFences[currentFrame], VK_TRUE, UINT64_MAX) == VK_TIMEOUT)
-            ;
+        framePacer.waitForFrame();
+        currentFrame = frameScheduler.beginFrame();
+
+        // The transfer submission that read this frame's share of the staging ring has finished long before, but has to for certain.
+        if (transferTimeline != NULL)
+        {
+            VkSemaphoreWaitInfo transferWaitInfo = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                .semaphoreCount = 1,
+                .pSemaphores = &transferTimeline,
+                .pValues = &frameTransferValues[currentFrame],
+            };
+
+            vkWaitSemaphores(device, &transferWaitInfo, UINT64_MAX);
+        }
+
+        stagingRing.releaseFrame(currentFrame);
+
+        takeLoadedMeshes();
 
         uint32_t imageIndex = 0;
 
-        vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, presentCompleteSemaphores[semaphoreIndex], VK_NULL_HANDLE, &imageIndex);
+        vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, presentCompleteSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+        updateUniformBuffer(currentFrame);
+        updateGeometryResidency();
+
+        // Everything the frame's command buffers hold is done with, so their pools are reset as a whole rather than buffer by buffer.
+        for (uint32_t i = 0; i < recordingThreads.getNumThreads(); i++)
+            vkResetCommandPool(device, getFrameCommandPool(currentFrame, i).pool, 0);
+
+        if (transferQueue != NULL)
+            submitGeometryUploads();
+
+        VkCommandBuffer commandBuffer = commandBuffers[currentFrame];
+
+        if (settings.cacheCommandBuffers && canCacheCommandBuffers())
+        {
+            bool valid = false;
+            commandBuffer = commandBufferCache.get(currentFrame, imageIndex, valid);
+
+            // Cached command buffers are recorded on the render thread only, as the recording threads' secondaries are reset every frame.
+            if (valid == false)
+                recordCommandBuffer(commandBuffer, imageIndex, false);
+        }
+        else
+        {
+            recordCommandBuffer(commandBuffer, imageIndex, true);
+        }
+
+        if (settings.cacheCommandBuffers && frameScheduler.getFrameNumber() % COMMAND_BUFFER_CACHE_STATS_INTERVAL == COMMAND_BUFFER_CACHE_STATS_INTERVAL - 1)
+            commandBufferCache.printStats();
+
+        stagingRing.endFrame(currentFrame);
+
+        // Geometry acquired from the transfer queue is first read by culling and vertex fetch. Binary semaphores ignore their value.
+        std::array<VkSemaphore, 2> waitSemaphores = {presentCompleteSemaphores[currentFrame], transferTimeline};
+        std::array<VkPipelineStageFlags, 2> waitDestinationStageMasks = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT};
+        std::array<uint64_t, 2> waitValues = {0, acquiredTransferValue};
+        uint32_t waitSemaphoreCount = transferTimeline != NULL ? 2 : 1;
+
+        // The frame's resources are free again once the timeline reaches its value.
+        std::array<VkSemaphore, 2> signalSemaphores = {renderFinishedSemaphores[imageIndex], frameScheduler.getTimeline()};
+        std::array<uint64_t, 2> signalValues = {0, frameScheduler.getSignalValue()};
+
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = waitSemaphoreCount,
+            .pWaitSemaphoreValues = waitValues.data(),
+            .signalSemaphoreValueCount = (uint32_t)signalValues.size(),
+            .pSignalSemaphoreValues = signalValues.data(),
+        };
+
+        VkSubmitInfo submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timelineSubmitInfo,
+            .waitSemaphoreCount = waitSemaphoreCount,
+            .pWaitSemaphores = waitSemaphores.data(),
+            .pWaitDstStageMask = waitDestinationStageMasks.data(),
+            .commandBufferCount = 1,
+            .pCommandBuffers = &commandBuffer,
+            .signalSemaphoreCount = (uint32_t)signalSemaphores.size(),
+            .pSignalSemaphores = signalSemaphores.data(),
+        };
+
+        vkQueueSubmit(graphicsQueue, 1, &submitInfo, NULL);
+
+        uint64_t presentId = framePacer.getPresentId();
+
+        VkPresentIdKHR presentIdInfo = {
+            .sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+            .swapchainCount = 1,
+            .pPresentIds = &presentId,
+        };
+
+        VkPresentInfoKHR presentInfo = {
+            .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+            .pNext = presentId != 0 ? &presentIdInfo : NULL,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &renderFinishedSemaphores[imageIndex],
+            .swapchainCount = 1,
+            .pSwapchains = &swapchain,
+            .pImageIndices = &imageIndex,
+        };
+
+        VkResult result = vkQueuePresentKHR(graphicsQueue, &presentInfo);
+
+        if (result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            extent = pendingExtent;
+            framebufferResized = false;
+
+            recreateSwapchain();
+        }
+        else if (result != VK_SUCCESS)
+        {
+            printf("Unexpected present error %d\n", result);
+        }
+
+        frameScheduler.endFrame();
+    }
+
+    // Records copies of newly loaded geometry through the staging ring into `commandBuffer`. Each frame copies at most its share of the
+    // ring, so large meshes take a few frames and the rest are queued behind them. Returns whether anything was copied.
+    bool recordGeometryCopies(VkCommandBuffer commandBuffer)
+    {
+        VkDeviceSize budget = STAGING_RING_FRAME_SIZE;
+        bool copied = false;
+
+        for (auto &mesh : meshes)
+        {
+            if (mesh.copied || mesh.geometryPage == UINT32_MAX)
+                continue;
+
+            const Obj &obj = *mesh.obj;
+
+            // Source, destination and size of each part.
+            const std::array<std::tuple<const void *, VkDeviceSize, VkDeviceSize>, 3> parts = {{
+                {obj.vertexData, mesh.geometryOffset, obj.vertexDataSize},
+                {obj.indexData, mesh.indexOffset, obj.indexDataSize},
+                {obj.meshletData, mesh.meshletOffset, obj.meshletDataSize},
+            }};
+
+            while (mesh.uploadPart < parts.size())
+            {
+                const auto &[source, destination, size] = parts[mesh.uploadPart];
+                VkDeviceSize chunkSize = std::min(size - mesh.uploadPartBytes, budget);
+                VkDeviceSize stagingOffset = 0;
+                void *staging = nullptr;
+
+                if (chunkSize > 0)
+                {
+                    if (stagingRing.allocate(chunkSize, STAGING_ALIGNMENT, stagingOffset, staging) == false)
+                        break;
+
+                    memcpy(staging, (const char *)source + mesh.uploadPartBytes, chunkSize);
+
+                    VkBufferCopy copyRegion = {
+                        .srcOffset = stagingOffset,
+                        .dstOffset = destination + mesh.uploadPartBytes,
+                        .size = chunkSize,
+                    };
+
+                    vkCmdCopyBuffer(commandBuffer, stagingRing.getBuffer(), geometryPages[mesh.geometryPage].buffer, 1, &copyRegion);
+
+                    budget -= chunkSize;
+                    mesh.uploadPartBytes += chunkSize;
+                    copied = true;
+                }
+
+                if (mesh.uploadPartBytes < size)
+                    break;
+
+                mesh.uploadPart++;
+                mesh.uploadPartBytes = 0;
+            }
+
+            mesh.copied = mesh.uploadPart == parts.size();
+
+            if (mesh.copied == false)
+                break;
+        }
+
+        return copied;
+    }
+
+    // Copies newly loaded geometry on the graphics queue, ahead of everything that reads it. Used when there is no transfer queue.
+    void recordGeometryUploads(VkCommandBuffer commandBuffer)
+    {
+        if (recordGeometryCopies(commandBuffer) == false)
+            return;
+
+        // The copies are the first thing in the frame to touch the pages, so there is nothing for them to wait for, only for culling and
+        // drawing to wait on them.
+        for (auto &mesh : meshes)
+        {
+            if (mesh.copied && mesh.uploaded == false)
+                frameBarriers.useBuffer(geometryPages[mesh.geometryPage].buffer, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+            mesh.uploaded = mesh.copied;
+        }
+    }
+
+    // Copies newly loaded geometry on the transfer queue, so that large uploads overlap rendering instead of delaying it. Geometry that
+    // is complete is released to the graphics queue, which acquires it in `recordGeometryAcquires` once the submission has finished.
+    void submitGeometryUploads()
+    {
+        VkCommandBuffer commandBuffer = transferCommandBuffers[currentFrame];
+
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+
+        vkResetCommandBuffer(commandBuffer, 0);
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        bool copied = recordGeometryCopies(commandBuffer);
+
+        bool released = false;
+
+        // Geometry written directly into host-visible memory is `uploaded` without any transfer to release.
+        for (const auto &mesh : meshes)
+        {
+            if (mesh.copied == false || mesh.uploaded || mesh.uploadValue != 0)
+                continue;
+
+            released = true;
+            transferBarriers.addBufferBarrier({
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+                .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+                .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                .srcQueueFamilyIndex = transferQueueFamilyIndex,
+                .dstQueueFamilyIndex = graphicsQueueFamilyIndex,
+                .buffer = geometryPages[mesh.geometryPage].buffer,
+                .offset = mesh.geometryOffset,
+                .size = mesh.geometrySize,
+            });
+        }
+
+        transferBarriers.flush(commandBuffer);
+        vkEndCommandBuffer(commandBuffer);
 
-        updateUniformBuffer(currentFrame);
+        if (copied == false && released == false)
+            return;
 
-        vkResetFences(device, 1, &inflightFences[currentFrame]);
-        vkResetCommandBuffer(commandBuffers[currentFrame], VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
-        recordCommandBuffer(imageIndex);
+        transferTimelineValue++;
 
-        VkPipelineStageFlags waitDestinationStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &transferTimelineValue,
+        };
 
         VkSubmitInfo submitInfo = {
             .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &presentCompleteSemaphores[semaphoreIndex],
-            .pWaitDstStageMask = &waitDestinationStageMask,
+            .pNext = &timelineSubmitInfo,
             .commandBufferCount = 1,
-            .pCommandBuffers = &commandBuffers[currentFrame],
+            .pCommandBuffers = &commandBuffer,
             .signalSemaphoreCount = 1,
-            .pSignalSemaphores = &renderFinishedSemaphores[imageIndex],
+            .pSignalSemaphores = &transferTimeline,
         };
 
-        vkQueueSubmit(graphicsQueue, 1, &submitInfo, inflightFences[currentFrame]);
+        vkQueueSubmit(transferQueue, 1, &submitInfo, NULL);
 
-        VkPresentInfoKHR presentInfo = {
-            .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &renderFinishedSemaphores[imageIndex],
-            .swapchainCount = 1,
-            .pSwapchains = &swapchain,
-            .pImageIndices = &imageIndex,
-        };
+        frameTransferValues[currentFrame] = transferTimelineValue;
 
-        VkResult result = vkQueuePresentKHR(graphicsQueue, &presentInfo);
+        for (auto &mesh : meshes)
+            if (mesh.copied && mesh.uploaded == false && mesh.uploadValue == 0)
+                mesh.uploadValue = transferTimelineValue;
+    }
 
-        if (result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR)
+    // Takes over the geometry whose transfer submissions have finished. Never waits: geometry still in flight is picked up by a later
+    // frame, and the frame's submission waits on the transfer timeline only for values it has already reached. The acquire barriers go
+    // out with the frame's first batch.
+    void recordGeometryAcquires()
+    {
+        uint64_t completedValue = 0;
+        vkGetSemaphoreCounterValue(device, transferTimeline, &completedValue);
+
+        for (auto &mesh : meshes)
         {
-            extent = pendingExtent;
-            framebufferResized = false;
+            if (mesh.uploaded || mesh.uploadValue == 0 || mesh.uploadValue > completedValue)
+                continue;
+
+            frameBarriers.addBufferBarrier({
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+                .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT,
+                .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT,
+                .srcQueueFamilyIndex = transferQueueFamilyIndex,
+                .dstQueueFamilyIndex = graphicsQueueFamilyIndex,
+                .buffer = geometryPages[mesh.geometryPage].buffer,
+                .offset = mesh.geometryOffset,
+                .size = mesh.geometrySize,
+            });
+
+            mesh.uploaded = true;
+            acquiredTransferValue = std::max(acquiredTransferValue, mesh.uploadValue);
+        }
+    }
 
-            recreateSwapchain();
+    // Declares the frame's passes: clearing the draw counts, culling the meshlets into draws, and drawing them into the swapchain image.
+    void buildFrameGraph(uint32_t imageIndex, bool parallel)
+    {
+        frameGraph.clear();
+
+        uint32_t clearPass = frameGraph.addPass([this](VkCommandBuffer commandBuffer)
+                                                {
+                                                    for (const auto &mesh : meshes)
+                                                        vkCmdFillBuffer(commandBuffer, mesh.drawCountBuffers[currentFrame], 0, sizeof(uint32_t), 0);
+                                                });
+
+        for (const auto &mesh : meshes)
+            frameGraph.useBuffer(clearPass, mesh.drawCountBuffers[currentFrame], VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+        // Culls the meshlets against the frustum and their normal cones, leaving one indirect draw per visible meshlet and the draw count
+        // in each mesh's buffers for this frame.
+        uint32_t cullPass = frameGraph.addPass([this](VkCommandBuffer commandBuffer)
+                                               {
+                                                   vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+
+                                                   for (const auto &mesh : meshes)
+                                                   {
+                                                       uint32_t numMeshlets = getNumCulledMeshlets(mesh);
+
+                                                       if (numMeshlets == 0)
+                                                           continue;
+
+                                                       vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &mesh.descriptorSets[currentFrame], 0, NULL);
+                                                       vkCmdDispatch(commandBuffer, (numMeshlets + MESHLET_CULL_GROUP_SIZE - 1) / MESHLET_CULL_GROUP_SIZE, 1, 1);
+                                                   }
+                                               });
+
+        for (const auto &mesh : meshes)
+        {
+            if (getNumCulledMeshlets(mesh) == 0)
+                continue;
+
+            frameGraph.useBuffer(cullPass, geometryPages[mesh.geometryPage].buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+            frameGraph.useBuffer(cullPass, mesh.drawCommandBuffers[currentFrame], VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+            frameGraph.useBuffer(cullPass, mesh.drawCountBuffers[currentFrame], VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
         }
-        else if (result != VK_SUCCESS)
+
+        uint32_t mainPass = frameGraph.addPass([this, imageIndex, parallel](VkCommandBuffer commandBuffer)
+                                               { recordMainPass(commandBuffer, imageIndex, parallel); });
+
+        // Both attachments are cleared, so neither keeps its contents.
+        frameGraph.useImage(mainPass, swapchainImageResource,
+                            {
+                                .stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                .accessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                                .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                            },
+                            true);
+        frameGraph.useImage(mainPass, depthImageResource,
+                            {
+                                .stageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                                .accessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                                .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                            },
+                            true);
+
+        for (const auto &mesh : meshes)
         {
-            printf("Unexpected present error %d\n", result);
+            if (mesh.uploaded == false || mesh.visible == false)
+                continue;
+
+            frameGraph.useBuffer(mainPass, geometryPages[mesh.geometryPage].buffer, VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT);
+            frameGraph.useBuffer(mainPass, mesh.drawCommandBuffers[currentFrame], VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+            frameGraph.useBuffer(mainPass, mesh.drawCountBuffers[currentFrame], VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
         }
 
-        semaphoreIndex = (semaphoreIndex + 1) % presentCompleteSemaphores.size();
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        frameGraph.addOutput(swapchainImageResource, {.layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR});
+        frameGraph.compile();
     }
 
-    void transitionSwapchainImageLayout(uint32_t imageIndex, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags2 srcAccessMask, VkAccessFlags2 dstAccessMask, VkPipelineStageFlags2 srcStageMask, VkPipelineStageFlags2 dstStageMask)
+    // The meshlets of `mesh` culling is dispatched for this frame.
+    uint32_t getNumCulledMeshlets(const RenderMesh &mesh)
     {
-        VkImageMemoryBarrier2 barrier = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-            .srcStageMask = srcStageMask,
-            .srcAccessMask = srcAccessMask,
-            .dstStageMask = dstStageMask,
-            .dstAccessMask = dstAccessMask,
-            .oldLayout = oldLayout,
-            .newLayout = newLayout,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = swapchainImages[imageIndex],
-            .subresourceRange = {
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = 1,
-            },
-        };
-
-        VkDependencyInfo dependencyInfo = {
-            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-            .imageMemoryBarrierCount = 1,
-            .pImageMemoryBarriers = &barrier,
-        };
-        vkCmdPipelineBarrier2(commandBuffers[currentFrame], &dependencyInfo);
+        return mesh.uploaded && mesh.visible && mesh.currentLod < mesh.obj->lods.size() ? mesh.obj->lods[mesh.currentLod].numMeshlets : 0;
     }
 
-    void recordCommandBuffer(uint32_t imageIndex)
+    // With `parallel`, draws may be split between the recording threads.
+    void recordMainPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool parallel)
     {
-        VkCommandBufferBeginInfo beginInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        };
-
-        vkBeginCommandBuffer(commandBuffers[currentFrame], &beginInfo);
-
-        transitionSwapchainImageLayout(imageIndex, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_2_NONE, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
-        transitionImageLayout(depthImage, VK_FORMAT_D32_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
-
         VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
         VkRenderingAttachmentInfo colorAttachmentInfo = {
             .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
@@ -749,33 +2735,6 @@ public:
             .clearValue = clearColor,
         };
 
-        VkImageMemoryBarrier2 depthBarrier = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-            .srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT,
-            .dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
-            .dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = depthImage,
-            .subresourceRange = {
-                .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = 1,
-            },
-        };
-
-        VkDependencyInfo depthDependencyInfo = {
-            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-            .imageMemoryBarrierCount = 1,
-            .pImageMemoryBarriers = &depthBarrier,
-        };
-
-        vkCmdPipelineBarrier2(commandBuffers[currentFrame], &depthDependencyInfo);
-
         VkRect2D scissor = {
             .offset = {0, 0},
             .extent = extent,
@@ -794,15 +2753,30 @@ public:
 
         VkRenderingAttachmentInfo depthAttachmentInfo = {
             .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
-            .imageView = depthImageView,
+            .imageView = transientAttachments.get(depthAttachment).view,
             .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
             .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
             .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
             .clearValue = clearDepth,
         };
 
+        // Meshes out of view are not referenced at all, so that their geometry can be evicted once it has been for long enough.
+        std::vector<const RenderMesh *> drawnMeshes = {};
+
+        for (const auto &mesh : meshes)
+            if (mesh.uploaded && mesh.visible)
+                drawnMeshes.push_back(&mesh);
+
+        std::stable_sort(drawnMeshes.begin(), drawnMeshes.end(), [](const RenderMesh *a, const RenderMesh *b)
+                         { return a->pipelineIndex < b->pipelineIndex; });
+
+        // Few draws are recorded straight into the frame's command buffer; more are split between the recording threads, each recording
+        // its share into a secondary command buffer from its own pool.
+        unsigned numThreads = parallel ? getUsefulThreadCount(recordingThreads.getNumThreads(), drawnMeshes.size(), MIN_DRAWS_PER_RECORDING_THREAD) : 1;
+
         VkRenderingInfo renderingInfo = {
             .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+            .flags = numThreads > 1 ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0u,
             .renderArea = scissor,
             .layerCount = 1,
             .colorAttachmentCount = 1,
@@ -810,377 +2784,521 @@ public:
             .pDepthAttachment = &depthAttachmentInfo,
         };
 
-        vkCmdBeginRendering(commandBuffers[currentFrame], &renderingInfo);
+        vkCmdBeginRendering(commandBuffer, &renderingInfo);
 
-        vkCmdBindPipeline(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
-        vkCmdPushConstants(commandBuffers[currentFrame], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::vec3), &cameraAngle);
+        if (numThreads == 1)
+        {
+            recordDraws(commandBuffer, scissor, drawnMeshes.data(), drawnMeshes.data() + drawnMeshes.size());
+        }
+        else
+        {
+            VkCommandBufferInheritanceRenderingInfo inheritanceRenderingInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+                .colorAttachmentCount = 1,
+                .pColorAttachmentFormats = &swapchainSurfaceFormat.format,
+                .depthAttachmentFormat = transientAttachments.get(depthAttachment).format,
+                .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+            };
 
-        vkCmdSetViewport(commandBuffers[currentFrame], 0, 1, &viewport);
-        vkCmdSetScissor(commandBuffers[currentFrame], 0, 1, &scissor);
+            VkCommandBufferInheritanceInfo inheritanceInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+                .pNext = &inheritanceRenderingInfo,
+            };
 
-        vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, NULL);
+            VkCommandBufferBeginInfo secondaryBeginInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+                .pInheritanceInfo = &inheritanceInfo,
+            };
 
-        VkDeviceSize offset = 0;
+            std::vector<VkCommandBuffer> secondaryCommandBuffers(numThreads);
 
-        vkCmdBindIndexBuffer(commandBuffers[currentFrame], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-        vkCmdBindVertexBuffers(commandBuffers[currentFrame], 0, 1, &vertexBuffer, &offset);
-        vkCmdDrawIndexed(commandBuffers[currentFrame], stanfordBunny.numIndices, 1, 0, 0, 0);
+            recordingThreads.run(numThreads, [&](unsigned threadIndex)
+                                 {
+                                     VkCommandBuffer secondaryCommandBuffer = getFrameCommandPool(currentFrame, threadIndex).secondaryCommandBuffer;
+                                     size_t begin = drawnMeshes.size() * threadIndex / numThreads;
+                                     size_t end = drawnMeshes.size() * (threadIndex + 1) / numThreads;
 
-        // vkCmdBindVertexBuffers(commandBuffers[currentFrame], 0, 1, &transferBuffer, &offset);
-        // vkCmdDraw(commandBuffers[currentFrame], 6, 1, 0, 0);
+                                     vkBeginCommandBuffer(secondaryCommandBuffer, &secondaryBeginInfo);
+                                     recordDraws(secondaryCommandBuffer, scissor, drawnMeshes.data() + begin, drawnMeshes.data() + end);
+                                     vkEndCommandBuffer(secondaryCommandBuffer);
 
-        vkCmdEndRendering(commandBuffers[currentFrame]);
+                                     secondaryCommandBuffers[threadIndex] = secondaryCommandBuffer;
+                                 });
 
-        transitionSwapchainImageLayout(imageIndex, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT);
+            vkCmdExecuteCommands(commandBuffer, numThreads, secondaryCommandBuffers.data());
+        }
 
-        vkEndCommandBuffer(commandBuffers[currentFrame]);
+        vkCmdEndRendering(commandBuffer);
     }
 
-    // MARK: Renderer: Init Vk res
-
-    void transitionImageLayout(const VkImage &image, const VkFormat &format, VkImageLayout oldLayout, VkImageLayout newLayout)
+    // Records the draws of the meshes in [begin, end) within the main pass. State is set anew, as secondary command buffers inherit none.
+    // Meshes come sorted by pipeline, so each is bound once.
+    void recordDraws(VkCommandBuffer commandBuffer, const VkRect2D &scissor, const RenderMesh *const *begin, const RenderMesh *const *end)
     {
-        VkCommandBuffer transitionCommandBuffer = beginSingleTimeCommands();
+        uint32_t boundPipeline = UINT32_MAX;
 
-        VkImageMemoryBarrier barrier = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .oldLayout = oldLayout,
-            .newLayout = newLayout,
-            .image = image,
-            .subresourceRange = {
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = 1,
-            },
-        };
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::vec3), &cameraAngle);
 
-        VkPipelineStageFlags sourceStage = NULL;
-        VkPipelineStageFlags destinationStage = NULL;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-        if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+        for (const RenderMesh *const *it = begin; it != end; it++)
         {
-            barrier.srcAccessMask = NULL;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            const RenderMesh &mesh = **it;
+            VkDeviceSize stride = mesh.obj->getVertexStride();
+            VkBuffer geometryBuffer = geometryPages[mesh.geometryPage].buffer;
 
-            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-            destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        }
-        else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-        {
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            if (mesh.pipelineIndex != boundPipeline)
+            {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh.pipeline);
+                boundPipeline = mesh.pipelineIndex;
+            }
 
-            sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &mesh.descriptorSets[currentFrame], 0, NULL);
+            vkCmdBindIndexBuffer(commandBuffer, geometryBuffer, mesh.indexOffset, mesh.obj->indexType);
+            vkCmdBindVertexBuffers2(commandBuffer, 0, 1, &geometryBuffer, &mesh.geometryOffset, NULL, &stride);
+            vkCmdDrawIndexedIndirectCount(commandBuffer, mesh.drawCommandBuffers[currentFrame], 0, mesh.drawCountBuffers[currentFrame], 0, mesh.obj->numMeshlets, sizeof(VkDrawIndexedIndirectCommand));
         }
-        else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL)
-        {
-            barrier.srcAccessMask = NULL;
-            barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    }
 
-            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-            destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-        }
-        else
-            printf("Invalid layout transition\n");
+    FrameCommandPool &getFrameCommandPool(uint32_t frameIndex, uint32_t threadIndex)
+    {
+        return frameCommandPools[frameIndex * recordingThreads.getNumThreads() + threadIndex];
+    }
 
-        if (format == VK_FORMAT_D32_SFLOAT)
-            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-        else
-            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool parallel)
+    {
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        };
 
-        // TODO: Use `vkCmdPipelineBarrier2`.
-        vkCmdPipelineBarrier(transitionCommandBuffer, sourceStage, destinationStage, NULL, 0, NULL, 0, NULL, 1, &barrier);
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        frameBarriers.resetBuffers();
 
-        endSingleTimeCommands(std::move(transitionCommandBuffer));
+        // Uploads and acquires update the meshes' state, so they come before the graph is built from it.
+        if (transferQueue != NULL)
+            recordGeometryAcquires();
+        else
+            recordGeometryUploads(commandBuffer);
+
+        // The swapchain image is ready once the acquire semaphore wait at color attachment output is.
+        frameBarriers.setImageState(swapchainImages[imageIndex], {.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT});
+        frameGraph.setImage(swapchainImageResource, swapchainImages[imageIndex]);
+
+        // The depth image was last written by the previous frame's main pass, even when the tracker has been reset since. Without
+        // this, the first frame after a reset would not wait for it, and neither would every replay of its cached command buffer.
+        VkImage depthImage = transientAttachments.get(depthAttachment).image;
+        frameBarriers.setImageState(depthImage, {
+                                                    .stageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                                                    .accessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                                                    .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                                                });
+        frameGraph.setImage(depthImageResource, depthImage);
+
+        buildFrameGraph(imageIndex, parallel);
+        frameGraph.execute(commandBuffer, frameBarriers);
+
+        vkEndCommandBuffer(commandBuffer);
     }
 
-    // Begins a single-time command buffer on the graphics queue.
-    VkCommandBuffer beginSingleTimeCommands()
+    // Whether the frame's command buffer may come from the cache, invalidating the cache first if the frame would record anything else
+    // than the last cached one did. Geometry still being uploaded or acquired records its copies and barriers, so frames with any are
+    // never cached. Barriers of cached command buffers are not tracked again when they are reused, which is fine as a cached frame
+    // leaves the images as it found them: the depth image's state is set before every recording instead of carried over.
+    bool canCacheCommandBuffers()
     {
-        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .commandPool = commandPool,
-            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            .commandBufferCount = 1,
-        };
+        std::vector<uint64_t> drawState = {};
+        drawState.reserve(meshes.size() * 2 + 2);
+
+        for (const auto &mesh : meshes)
+        {
+            if (mesh.geometryPage != UINT32_MAX && mesh.uploaded == false)
+                return false;
 
-        VkCommandBuffer singleTimeCommandBuffer = NULL;
+            // The index and meshlet offsets follow from the geometry offset, and are recorded in binds and the meshlet descriptor.
+            drawState.push_back((uint64_t)mesh.geometryPage << 32 | (uint64_t)mesh.currentLod << 2 | (uint64_t)mesh.visible << 1 | (uint64_t)mesh.uploaded);
+            drawState.push_back(mesh.geometryOffset);
+        }
 
-        vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &singleTimeCommandBuffer);
+        // The camera direction is recorded as a push constant.
+        uint64_t cameraBits[2] = {};
+        memcpy(cameraBits, &cameraAngle, sizeof(cameraAngle));
+        drawState.insert(drawState.end(), std::begin(cameraBits), std::end(cameraBits));
 
-        VkCommandBufferBeginInfo commandBufferBeginInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        };
+        if (drawState == cachedDrawState)
+            return true;
 
-        vkBeginCommandBuffer(singleTimeCommandBuffer, &commandBufferBeginInfo);
+        cachedDrawState = std::move(drawState);
+        commandBufferCache.invalidate();
 
-        return singleTimeCommandBuffer;
+        return true;
     }
 
-    void endSingleTimeCommands(VkCommandBuffer &&singleTimeCommandBuffer)
-    {
-        vkEndCommandBuffer(singleTimeCommandBuffer);
+    // MARK: Renderer: Init Vk res
 
-        VkSubmitInfo submitInfo = {
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &singleTimeCommandBuffer,
+    // Creates a buffer bound to a range of the first memory type with all of `properties`, accounted to `category`.
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, GpuMemoryCategory category, VkBuffer &buffer, GpuAllocation &allocation)
+    {
+        VkBufferCreateInfo bufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = size,
+            .usage = usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
         };
 
-        vkQueueSubmit(graphicsQueue, 1, &submitInfo, NULL);
+        vkCreateBuffer(device, &bufferInfo, NULL, &buffer);
 
-        vkQueueWaitIdle(graphicsQueue);
+        VkMemoryRequirements memoryRequirements = {};
+        vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+
+        allocation = memoryAllocator.allocate(memoryRequirements, properties, false, category);
+        vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
     }
 
-    void createDepthResources()
+    void destroyBuffer(VkBuffer &buffer, GpuAllocation &allocation)
     {
-        // Creating the depth image.
+        if (buffer != NULL)
+            vkDestroyBuffer(device, buffer, NULL);
 
-        VkImageCreateInfo imageInfo = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-            .imageType = VK_IMAGE_TYPE_2D,
-            .format = VK_FORMAT_D32_SFLOAT,
-            .extent = {extent.width, extent.height, 1},
-            .mipLevels = 1,
-            .arrayLayers = 1,
-            .samples = VK_SAMPLE_COUNT_1_BIT,
-            .tiling = VK_IMAGE_TILING_OPTIMAL,
-            .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        };
+        memoryAllocator.free(allocation);
+        buffer = NULL;
+    }
 
-        vkCreateImage(device, &imageInfo, NULL, &depthImage);
+    // Creates the buffers and descriptor sets `mesh` is culled and drawn with. Runs on a loader thread, and only touches objects it
+    // creates: the mesh's geometry is placed by the render thread once it comes into view.
+    void createMeshResources(RenderMesh &mesh)
+    {
+        const Obj &obj = *mesh.obj;
 
-        VkMemoryRequirements imageMemoryRequirements = {};
+        mesh.geometrySize = getMeshletOffset(obj) + std::max(obj.meshletDataSize, sizeof(Meshlet));
 
-        vkGetImageMemoryRequirements(device, depthImage, &imageMemoryRequirements);
+        VkDeviceSize drawCommandsSize = sizeof(VkDrawIndexedIndirectCommand) * std::max(obj.numMeshlets, 1u);
 
-        VkMemoryAllocateInfo imageMemoryAllocateInfo = {
-            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-            .allocationSize = imageMemoryRequirements.size,
-            .memoryTypeIndex = getBufferMemoryTypeBitOrder(imageMemoryRequirements, (VkMemoryPropertyFlagBits)VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
-        };
+        mesh.uniformBuffers.resize(settings.framesInFlight);
+        mesh.uniformBufferAllocations.resize(settings.framesInFlight);
+        mesh.drawCommandBuffers.resize(settings.framesInFlight);
+        mesh.drawCommandBufferAllocations.resize(settings.framesInFlight);
+        mesh.drawCountBuffers.resize(settings.framesInFlight);
+        mesh.drawCountBufferAllocations.resize(settings.framesInFlight);
+        mesh.descriptorSets.resize(settings.framesInFlight);
 
-        vkAllocateMemory(device, &imageMemoryAllocateInfo, NULL, &depthImageMemory);
+        for (uint32_t i = 0; i < settings.framesInFlight; i++)
+        {
+            createBuffer(sizeof(UniformBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, GPU_MEMORY_UNIFORMS, mesh.uniformBuffers[i], mesh.uniformBufferAllocations[i]);
 
-        vkBindImageMemory(device, depthImage, depthImageMemory, 0);
+            createBuffer(drawCommandsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GPU_MEMORY_DRAWS, mesh.drawCommandBuffers[i], mesh.drawCommandBufferAllocations[i]);
+            createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GPU_MEMORY_DRAWS, mesh.drawCountBuffers[i], mesh.drawCountBufferAllocations[i]);
+        }
 
-        // Creating the depth image view.
+        // Each mesh has its own pool, so that loader threads never share one.
 
-        VkImageViewCreateInfo depthImageViewInfo = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-            .image = depthImage,
-            .viewType = VK_IMAGE_VIEW_TYPE_2D,
-            .format = VK_FORMAT_D32_SFLOAT,
-            .subresourceRange = {
-                .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = 1,
+        std::array<VkDescriptorPoolSize, 2> descriptorPoolSizes = {{
+            {
+                .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .descriptorCount = settings.framesInFlight,
+            },
+            {
+                .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 3 * settings.framesInFlight,
             },
+        }};
+
+        VkDescriptorPoolCreateInfo descriptorPoolInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .maxSets = settings.framesInFlight,
+            .poolSizeCount = (uint32_t)descriptorPoolSizes.size(),
+            .pPoolSizes = descriptorPoolSizes.data(),
+        };
+
+        vkCreateDescriptorPool(device, &descriptorPoolInfo, NULL, &mesh.descriptorPool);
+
+        VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = mesh.descriptorPool,
+            .descriptorSetCount = (uint32_t)descriptorSetLayouts.size(),
+            .pSetLayouts = descriptorSetLayouts.data(),
         };
 
-        vkCreateImageView(device, &depthImageViewInfo, NULL, &depthImageView);
+        vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, mesh.descriptorSets.data());
+
+        for (uint32_t i = 0; i < settings.framesInFlight; i++)
+        {
+            // Binding 1, the meshlets, is written whenever the mesh is made resident.
+            std::array<VkDescriptorBufferInfo, 4> descriptorBufferInfos = {{
+                {
+                    .buffer = mesh.uniformBuffers[i],
+                    .offset = 0,
+                    .range = sizeof(UniformBufferObject),
+                },
+                {},
+                {
+                    .buffer = mesh.drawCommandBuffers[i],
+                    .offset = 0,
+                    .range = VK_WHOLE_SIZE,
+                },
+                {
+                    .buffer = mesh.drawCountBuffers[i],
+                    .offset = 0,
+                    .range = VK_WHOLE_SIZE,
+                },
+            }};
+
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {};
+
+            for (uint32_t binding = 0; binding < descriptorBufferInfos.size(); binding++)
+            {
+                if (binding == 1)
+                    continue;
+
+                writeDescriptorSets.push_back({
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = mesh.descriptorSets[i],
+                    .dstBinding = binding,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .pBufferInfo = &descriptorBufferInfos[binding],
+                });
+            }
+
+            vkUpdateDescriptorSets(device, (uint32_t)writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+        }
     }
 
-    // TODO: Rework this so it's only used when necessary (i.e. when there's no graphics queue family with transfer).
-    // TODO: Rework this so it can be done at draw time and more efficiently, e.g. keeping staging buffers mapped and doing the operations as part of the graphics pipeline by using barriers.
-    void transferData()
+    // Where a mesh's indices and meshlets start within its range of a geometry page.
+    static VkDeviceSize getIndexOffset(const Obj &obj)
     {
-        std::array<uint32_t, 2> queueFamilyIndices = {
-            transferQueueFamilyIndex,
-            graphicsQueueFamilyIndex,
-        };
+        return alignUp(obj.vertexDataSize, GEOMETRY_ALIGNMENT);
+    }
 
-        VkBufferCreateInfo stagingBufferInfo = {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-            .size = sizeof(upperTrapezoid[0]) * upperTrapezoid.size(),
-            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            .sharingMode = VK_SHARING_MODE_CONCURRENT,
-            .queueFamilyIndexCount = (uint32_t)queueFamilyIndices.size(),
-            .pQueueFamilyIndices = queueFamilyIndices.data(),
-        };
+    static VkDeviceSize getMeshletOffset(const Obj &obj)
+    {
+        return getIndexOffset(obj) + alignUp(obj.indexDataSize, GEOMETRY_ALIGNMENT);
+    }
 
-        VkBuffer stagingBuffer = NULL;
+    // Makes the meshes that are in view resident, and evicts those that have been out of it for `GEOMETRY_EVICTION_DELAY_FRAMES`: one a
+    // frame while the geometry heap is over budget, and as many as it takes when a mesh coming into view does not fit otherwise. A mesh
+    // that still does not fit, and those after it, are tried again next frame.
+    void updateGeometryResidency()
+    {
+        uint32_t numEvicted = 0;
 
-        vkCreateBuffer(device, &stagingBufferInfo, NULL, &stagingBuffer);
+        for (auto &mesh : meshes)
+            if (mesh.visible)
+                mesh.lastVisibleFrame = frameScheduler.getFrameNumber();
 
-        VkMemoryRequirements stagingMemoryRequirements = {};
+        GpuHeapBudget budget = memoryAllocator.getHeapBudget(geometryHeapIndex);
 
-        vkGetBufferMemoryRequirements(device, stagingBuffer, &stagingMemoryRequirements);
+        if (budget.usage > budget.budget * GPU_MEMORY_BUDGET_THRESHOLD && evictGeometry())
+            numEvicted++;
 
-        VkMemoryAllocateInfo stagingMemoryAllocateInfo = {
-            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-            .allocationSize = stagingMemoryRequirements.size,
-            .memoryTypeIndex = getBufferMemoryTypeBitOrder(stagingMemoryRequirements, (VkMemoryPropertyFlagBits)(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)),
-        };
+        for (auto &mesh : meshes)
+        {
+            if (mesh.visible == false || mesh.geometryPage != UINT32_MAX)
+                continue;
 
-        VkDeviceMemory stagingMemory = NULL;
+            while (takeGeometry(mesh) == false && evictGeometry())
+                numEvicted++;
 
-        vkAllocateMemory(device, &stagingMemoryAllocateInfo, NULL, &stagingMemory);
-        vkBindBufferMemory(device, stagingBuffer, stagingMemory, 0);
+            if (mesh.geometryPage == UINT32_MAX)
+                break;
+        }
 
-        void *data = nullptr;
+        // A mesh that did not fit can only fit later if something is evicted by then: a mesh out of view that is still within its delay,
+        // or more of what this frame evicted from. Otherwise waiting on frames would not help it.
+        bool deferred = std::any_of(meshes.begin(), meshes.end(), [](const RenderMesh &mesh)
+                                    { return mesh.visible && mesh.geometryPage == UINT32_MAX; });
+        bool evictable = std::any_of(meshes.begin(), meshes.end(), [this](const RenderMesh &mesh)
+                                     { return mesh.visible == false && mesh.geometryPage != UINT32_MAX &&
+                                              mesh.lastVisibleFrame + GEOMETRY_EVICTION_DELAY_FRAMES > frameScheduler.getFrameNumber(); });
 
-        vkMapMemory(device, stagingMemory, 0, stagingBufferInfo.size, NULL, &data);
-        memcpy(data, upperTrapezoid.data(), stagingBufferInfo.size);
-        vkUnmapMemory(device, stagingMemory);
+        residencyPending = deferred && (numEvicted > 0 || evictable);
 
-        VkBufferCreateInfo destinationBufferInfo = {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-            .size = sizeof(upperTrapezoid[0]) * upperTrapezoid.size(),
-            .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        };
-        vkCreateBuffer(device, &destinationBufferInfo, NULL, &transferBuffer);
-        VkMemoryRequirements destinationMemoryRequirements = {};
-        vkGetBufferMemoryRequirements(device, transferBuffer, &destinationMemoryRequirements);
-        VkMemoryAllocateInfo destinationMemoryAllocateInfo = {
-            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-            .allocationSize = destinationMemoryRequirements.size,
-            .memoryTypeIndex = getBufferMemoryTypeBitOrder(destinationMemoryRequirements, (VkMemoryPropertyFlagBits)VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
-        };
-        vkAllocateMemory(device, &destinationMemoryAllocateInfo, NULL, &transferBufferMemory);
-        vkBindBufferMemory(device, transferBuffer, transferBufferMemory, 0);
+        if (numEvicted > 0)
+            printMemoryStats();
+    }
 
-        VkCommandBufferBeginInfo transferBeginInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        };
+    // Takes a range for `mesh` from the first geometry page with room, or from a new page when the geometry heap's budget has room for
+    // one, and points its meshlet descriptors at it. Host-visible pages are written straight away; anything else is uploaded by
+    // `recordGeometryCopies`.
+    bool takeGeometry(RenderMesh &mesh)
+    {
+        const Obj &obj = *mesh.obj;
+        uint32_t order = BuddyRanges::getOrder(mesh.geometrySize);
+        uint32_t pageIndex = UINT32_MAX;
 
-        vkResetCommandBuffer(transferCommandBuffer, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
-        vkBeginCommandBuffer(transferCommandBuffer, &transferBeginInfo);
+        for (uint32_t i = 0; i < geometryPages.size() && pageIndex == UINT32_MAX; i++)
+            if (geometryPages[i].buffer != NULL && geometryPages[i].ranges.take(order, mesh.geometryOffset))
+                pageIndex = i;
 
-        VkBufferCopy bufferCopyRegion = {
-            .srcOffset = 0,
-            .dstOffset = 0,
-            .size = destinationBufferInfo.size,
-        };
+        if (pageIndex == UINT32_MAX)
+        {
+            VkDeviceSize pageSize = std::max(GEOMETRY_PAGE_SIZE, std::bit_ceil(mesh.geometrySize));
+            GpuHeapBudget budget = memoryAllocator.getHeapBudget(geometryHeapIndex);
 
-        vkCmdCopyBuffer(transferCommandBuffer, stagingBuffer, transferBuffer, 1, &bufferCopyRegion);
+            if (budget.usage + pageSize > budget.budget * GPU_MEMORY_BUDGET_THRESHOLD)
+                return false;
 
-        vkEndCommandBuffer(transferCommandBuffer);
+            auto emptyPage = std::find_if(geometryPages.begin(), geometryPages.end(), [](const GeometryPage &page)
+                                          { return page.buffer == NULL; });
+            pageIndex = (uint32_t)(emptyPage - geometryPages.begin());
 
-        VkSubmitInfo submitInfo = {
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &transferCommandBuffer,
-        };
+            if (emptyPage == geometryPages.end())
+                geometryPages.emplace_back();
 
-        vkQueueSubmit(transferQueue, 1, &submitInfo, NULL);
+            GeometryPage &page = geometryPages[pageIndex];
 
-        vkDeviceWaitIdle(device);
+            createBuffer(pageSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, geometryMemoryProperties, GPU_MEMORY_GEOMETRY, page.buffer, page.allocation);
+            page.ranges = BuddyRanges(pageSize);
+            page.ranges.take(order, mesh.geometryOffset);
+        }
 
-        vkFreeMemory(device, stagingMemory, NULL);
-        vkDestroyBuffer(device, stagingBuffer, NULL);
-        vkFreeMemory(device, transferBufferMemory, NULL);
-        vkDestroyBuffer(device, transferBuffer, NULL);
-    }
+        GeometryPage &page = geometryPages[pageIndex];
+        page.numMeshes++;
 
-    uint32_t getBufferMemoryTypeBitOrder(VkMemoryRequirements requirements, VkMemoryPropertyFlagBits requestedProperties)
-    {
-        const auto &properties = physicalDeviceMemoryProperties.memoryProperties;
+        mesh.geometryPage = pageIndex;
+        mesh.indexOffset = mesh.geometryOffset + getIndexOffset(obj);
+        mesh.meshletOffset = mesh.geometryOffset + getMeshletOffset(obj);
 
-        for (uint32_t i = 0; i < properties.memoryTypeCount; i++)
+        if (page.allocation.mapped != nullptr)
         {
-            if ((requirements.memoryTypeBits & (1 << i)) &&
-                (properties.memoryTypes[i].propertyFlags & requestedProperties))
-            {
-                return i;
-            }
+            char *geometry = (char *)page.allocation.mapped + mesh.geometryOffset;
+
+            memcpy(geometry, obj.vertexData, obj.vertexDataSize);
+            memcpy(geometry + getIndexOffset(obj), obj.indexData, obj.indexDataSize);
+            memcpy(geometry + getMeshletOffset(obj), obj.meshletData, obj.meshletDataSize);
+
+            mesh.copied = true;
+            mesh.uploaded = true;
         }
 
-        return UINT32_MAX;
+        // No frame in flight uses these sets: the mesh has not been drawn since it was last evicted, if ever.
+        VkDescriptorBufferInfo meshletBufferInfo = {
+            .buffer = page.buffer,
+            .offset = mesh.meshletOffset,
+            .range = std::max(obj.meshletDataSize, sizeof(Meshlet)),
+        };
+
+        std::vector<VkWriteDescriptorSet> writeDescriptorSets = {};
+
+        for (const auto &descriptorSet : mesh.descriptorSets)
+        {
+            writeDescriptorSets.push_back({
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = descriptorSet,
+                .dstBinding = 1,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &meshletBufferInfo,
+            });
+        }
+
+        vkUpdateDescriptorSets(device, (uint32_t)writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+
+        return true;
     }
 
-    void initializeVulkanResources()
+    // Evicts the resident mesh that has been out of view the longest, if that is long enough and it is not halfway through an upload.
+    // Returns whether there was one.
+    bool evictGeometry()
     {
-        while (swapchain == NULL)
+        RenderMesh *evicted = nullptr;
+
+        for (auto &mesh : meshes)
         {
-            createSwapchain();
-            if (shouldDestruct)
-            {
-                return;
-            }
-        }
+            bool uploading = mesh.uploaded == false && (mesh.uploadPart > 0 || mesh.uploadPartBytes > 0);
 
-        // Vertex  buffer creation.
+            if (mesh.geometryPage == UINT32_MAX || uploading || mesh.lastVisibleFrame + GEOMETRY_EVICTION_DELAY_FRAMES > frameScheduler.getFrameNumber())
+                continue;
 
-        VkBufferCreateInfo vertexBufferInfo = {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-            .size = stanfordBunny.vertexDataSize,
-            .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        };
+            if (evicted == nullptr || mesh.lastVisibleFrame < evicted->lastVisibleFrame)
+                evicted = &mesh;
+        }
 
-        vkCreateBuffer(device, &vertexBufferInfo, NULL, &vertexBuffer);
+        if (evicted == nullptr)
+            return false;
 
-        VkMemoryRequirements vertexMemoryRequirements = {};
-        vkGetBufferMemoryRequirements(device, vertexBuffer, &vertexMemoryRequirements);
+        printf("Evicting %s, unseen for %llu frames\n", evicted->name.c_str(), (unsigned long long)(frameScheduler.getFrameNumber() - evicted->lastVisibleFrame));
+        releaseGeometry(*evicted);
 
-        VkMemoryAllocateInfo memoryAllocateInfo = {
-            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-            .allocationSize = vertexMemoryRequirements.size,
-            .memoryTypeIndex = getBufferMemoryTypeBitOrder(vertexMemoryRequirements, (VkMemoryPropertyFlagBits)(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)),
-        };
+        return true;
+    }
 
-        vkAllocateMemory(device, &memoryAllocateInfo, NULL, &vertexBufferMemory);
+    // Gives back `mesh`'s range, destroying its page once empty, and leaves the mesh to be uploaded again before it is next drawn. No frame
+    // in flight may read the range.
+    void releaseGeometry(RenderMesh &mesh)
+    {
+        if (mesh.geometryPage == UINT32_MAX)
+            return;
 
-        vkBindBufferMemory(device, vertexBuffer, vertexBufferMemory, 0);
+        GeometryPage &page = geometryPages[mesh.geometryPage];
+        page.ranges.give(BuddyRanges::getOrder(mesh.geometrySize), mesh.geometryOffset);
 
-        void *vertexData = nullptr;
-        vkMapMemory(device, vertexBufferMemory, 0, vertexBufferInfo.size, NULL, &vertexData);
+        if (--page.numMeshes == 0)
+        {
+            destroyBuffer(page.buffer, page.allocation);
+            page = {};
+        }
 
-        memcpy(vertexData, stanfordBunny.vertexData, vertexBufferInfo.size);
+        mesh.geometryPage = UINT32_MAX;
+        mesh.uploadPart = 0;
+        mesh.uploadPartBytes = 0;
+        mesh.copied = false;
+        mesh.uploadValue = 0;
+        mesh.uploaded = false;
+    }
 
-        vkUnmapMemory(device, vertexBufferMemory);
+    // The device must be idle, or at least done with every frame that drew `mesh`.
+    void destroyMeshResources(RenderMesh &mesh)
+    {
+        if (mesh.descriptorPool != NULL)
+            vkDestroyDescriptorPool(device, mesh.descriptorPool, NULL);
+        for (uint32_t i = 0; i < mesh.uniformBuffers.size(); i++)
+            destroyBuffer(mesh.uniformBuffers[i], mesh.uniformBufferAllocations[i]);
+        for (uint32_t i = 0; i < mesh.drawCommandBuffers.size(); i++)
+            destroyBuffer(mesh.drawCommandBuffers[i], mesh.drawCommandBufferAllocations[i]);
+        for (uint32_t i = 0; i < mesh.drawCountBuffers.size(); i++)
+            destroyBuffer(mesh.drawCountBuffers[i], mesh.drawCountBufferAllocations[i]);
+        releaseGeometry(mesh);
+
+        mesh = {};
+    }
 
-        // TODO: Deduplicate code above and below.
-        // TODO: Store everything in one buffer and use offsets.
+    // Returns the index of the pipeline `obj` is drawn with and the pipeline itself, creating one the first time its vertex layout is
+    // seen. Called from the loader threads; meshes are mostly loaded the same way, so only the first of each kind waits on a creation.
+    uint32_t getMeshPipeline(Obj &obj, VkPipeline &pipeline)
+    {
+        std::vector<VkVertexInputAttributeDescription> attributes = {};
 
-        VkBufferCreateInfo indexBufferInfo = {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-            .size = stanfordBunny.indexDataSize,
-            .usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        };
-        vkCreateBuffer(device, &indexBufferInfo, NULL, &indexBuffer);
-        VkMemoryRequirements indexMemoryRequirements = {};
-        vkGetBufferMemoryRequirements(device, indexBuffer, &indexMemoryRequirements);
-        VkMemoryAllocateInfo indexAllocateInfo = {
-            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-            .allocationSize = indexMemoryRequirements.size,
-            .memoryTypeIndex = getBufferMemoryTypeBitOrder(indexMemoryRequirements, (VkMemoryPropertyFlagBits)(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)),
-        };
-        vkAllocateMemory(device, &indexAllocateInfo, NULL, &indexBufferMemory);
-        vkBindBufferMemory(device, indexBuffer, indexBufferMemory, 0);
-        void *indexData = nullptr;
-        vkMapMemory(device, indexBufferMemory, 0, indexBufferInfo.size, NULL, &indexData);
-        memcpy(indexData, stanfordBunny.indexData, indexBufferInfo.size);
-        vkUnmapMemory(device, indexBufferMemory);
+        for (const auto &attribute : obj.getAttributeDescription())
+            if (attribute.location < MESH_VERTEX_SHADER_INPUTS)
+                attributes.push_back(attribute);
 
-        // Graphics pipeline creation.
+        std::lock_guard<std::mutex> lock(meshPipelineMutex);
 
-        FILE *shaderFile = fopen("shader.spv", "rb");
-        fseek(shaderFile, 0, SEEK_END);
-        std::vector<char> shaderCode(ftell(shaderFile));
-        fseek(shaderFile, 0, SEEK_SET);
-        fread(shaderCode.data(), 1, shaderCode.size(), shaderFile);
-        fclose(shaderFile);
+        for (uint32_t i = 0; i < meshPipelines.size(); i++)
+        {
+            if (meshPipelines[i].attributes.size() == attributes.size() &&
+                memcmp(meshPipelines[i].attributes.data(), attributes.data(), sizeof(attributes[0]) * attributes.size()) == 0)
+            {
+                pipeline = meshPipelines[i].pipeline;
+                return i;
+            }
+        }
 
-        VkShaderModuleCreateInfo shaderModuleInfo = {
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .codeSize = shaderCode.size(),
-            .pCode = (uint32_t *)shaderCode.data(),
-        };
+        pipeline = createMeshPipeline(attributes);
+        meshPipelines.push_back({
+            .attributes = attributes,
+            .pipeline = pipeline,
+        });
 
-        if (vkCreateShaderModule(device, &shaderModuleInfo, NULL, &shaderModule) != VK_SUCCESS)
-            printf("Failed to create shader module\n");
+        return (uint32_t)meshPipelines.size() - 1;
+    }
 
+    VkPipeline createMeshPipeline(const std::vector<VkVertexInputAttributeDescription> &attributes)
+    {
         VkPipelineShaderStageCreateInfo vertexShaderStageInfo = {
             .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
             .stage = VK_SHADER_STAGE_VERTEX_BIT,
@@ -1200,108 +3318,18 @@ public:
             fragmentShaderStageInfo,
         };
 
-        VkDescriptorSetLayoutBinding uboLayoutBindingInfo = {
+        // The stride is set per mesh when its vertex buffer is bound.
+        VkVertexInputBindingDescription bindingDescription = {
             .binding = 0,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = 1,
-            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-        };
-
-        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo = {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-            .bindingCount = 1,
-            .pBindings = &uboLayoutBindingInfo,
-        };
-
-        uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
-        descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-        descriptorSetLayouts.resize(MAX_FRAMES_IN_FLIGHT);
-
-        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-        {
-            VkBufferCreateInfo bufferCreateInfo = {
-                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-                .size = sizeof(UniformBufferObject),
-                .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-            };
-
-            vkCreateBuffer(device, &bufferCreateInfo, NULL, &uniformBuffers[i]);
-
-            VkMemoryRequirements memoryRequirements = {};
-
-            vkGetBufferMemoryRequirements(device, uniformBuffers[i], &memoryRequirements);
-
-            VkMemoryAllocateInfo memoryAllocateInfo = {
-                .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-                .allocationSize = sizeof(UniformBufferObject),
-                .memoryTypeIndex = getBufferMemoryTypeBitOrder(memoryRequirements, (VkMemoryPropertyFlagBits)(VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)),
-            };
-
-            vkAllocateMemory(device, &memoryAllocateInfo, NULL, &uniformBuffersMemory[i]);
-
-            vkBindBufferMemory(device, uniformBuffers[i], uniformBuffersMemory[i], 0);
-
-            vkMapMemory(device, uniformBuffersMemory[i], 0, memoryAllocateInfo.allocationSize, NULL, &uniformBuffersMapped[i]);
-
-            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutInfo, NULL, &descriptorSetLayouts[i]);
-        }
-
-        VkDescriptorPoolSize descriptorPoolSize = {
-            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = MAX_FRAMES_IN_FLIGHT,
-        };
-
-        VkDescriptorPoolCreateInfo descriptorPoolInfo = {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-            .maxSets = MAX_FRAMES_IN_FLIGHT,
-            .poolSizeCount = 1,
-            .pPoolSizes = &descriptorPoolSize,
-        };
-
-        vkCreateDescriptorPool(device, &descriptorPoolInfo, NULL, &descriptorPool);
-
-        VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-            .descriptorPool = descriptorPool,
-            .descriptorSetCount = (uint32_t)descriptorSetLayouts.size(),
-            .pSetLayouts = descriptorSetLayouts.data(),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
         };
 
-        vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, descriptorSets.data());
-
-        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-        {
-            VkDescriptorBufferInfo descriptorBufferInfo = {
-                .buffer = uniformBuffers[i],
-                .offset = 0,
-                .range = sizeof(UniformBufferObject),
-            };
-
-            VkWriteDescriptorSet writeDescriptorSet = {
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .dstSet = descriptorSets[i],
-                .dstBinding = 0,
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                .pBufferInfo = &descriptorBufferInfo,
-            };
-
-            vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, NULL);
-        }
-
-        auto bindingDescription = stanfordBunny.getBindingDescription();
-        auto attributeDescriptions = stanfordBunny.getAttributeDescription();
-
         VkPipelineVertexInputStateCreateInfo vertexInputStateInfo = {
             .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
             .vertexBindingDescriptionCount = 1,
             .pVertexBindingDescriptions = &bindingDescription,
-            .vertexAttributeDescriptionCount = (uint32_t)attributeDescriptions.size(),
-            .pVertexAttributeDescriptions = attributeDescriptions.data(),
+            .vertexAttributeDescriptionCount = (uint32_t)attributes.size(),
+            .pVertexAttributeDescriptions = attributes.data(),
         };
 
         VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateInfo = {
@@ -1309,14 +3337,15 @@ public:
             .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
         };
 
-        VkDynamicState dynamicStates[2] = {
+        VkDynamicState dynamicStates[3] = {
             VK_DYNAMIC_STATE_VIEWPORT,
             VK_DYNAMIC_STATE_SCISSOR,
+            VK_DYNAMIC_STATE_VERTEX_INPUT_BINDING_STRIDE,
         };
 
         VkPipelineDynamicStateCreateInfo dynamicStateInfo = {
             .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-            .dynamicStateCount = 2,
+            .dynamicStateCount = 3,
             .pDynamicStates = dynamicStates,
         };
 
@@ -1349,26 +3378,10 @@ public:
             .pAttachments = &colorBlendAttachmentState,
         };
 
-        VkPushConstantRange pushConstantRange = {
-            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-            .offset = 0,
-            .size = sizeof(glm::vec3),
-        };
-
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-            .setLayoutCount = (uint32_t)descriptorSetLayouts.size(),
-            .pSetLayouts = descriptorSetLayouts.data(),
-            .pushConstantRangeCount = 1,
-            .pPushConstantRanges = &pushConstantRange,
-        };
-
-        vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipelineLayout);
-
         VkPipelineRenderingCreateInfo pipelineRenderingInfo = {
             .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
             .colorAttachmentCount = 1,
-            .pColorAttachmentFormats = &swapchainSurfaceFormat.format,
+            .pColorAttachmentFormats = &meshPipelineColorFormat,
             .depthAttachmentFormat = VK_FORMAT_D32_SFLOAT,
         };
 
@@ -1401,50 +3414,206 @@ public:
             .renderPass = NULL,
         };
 
+        VkPipeline pipeline = NULL;
+
         if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &graphicsPipelineInfo, NULL, &pipeline) != VK_SUCCESS)
             printf("Graphics pipeline creation failed\n");
 
-        // Command pool and command buffer creation.
+        return pipeline;
+    }
 
-        VkCommandPoolCreateInfo commandPoolInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-            .queueFamilyIndex = graphicsQueueFamilyIndex,
+    void initializeVulkanResources()
+    {
+        if (createSwapchainWhenVisible() == false)
+            return;
+
+        // Shader module and pipeline layout creation. Graphics pipelines are created for each vertex layout as meshes with it are loaded,
+        // for the swapchain's format now, as the loader threads cannot read it while the swapchain is recreated.
+
+        meshPipelineColorFormat = swapchainSurfaceFormat.format;
+
+        FILE *shaderFile = fopen("shader.spv", "rb");
+        fseek(shaderFile, 0, SEEK_END);
+        std::vector<char> shaderCode(ftell(shaderFile));
+        fseek(shaderFile, 0, SEEK_SET);
+        fread(shaderCode.data(), 1, shaderCode.size(), shaderFile);
+        fclose(shaderFile);
+
+        VkShaderModuleCreateInfo shaderModuleInfo = {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = shaderCode.size(),
+            .pCode = (uint32_t *)shaderCode.data(),
         };
 
-        if (vkCreateCommandPool(device, &commandPoolInfo, NULL, &commandPool) != VK_SUCCESS)
-            printf("Command pool creation failed\n");
+        if (vkCreateShaderModule(device, &shaderModuleInfo, NULL, &shaderModule) != VK_SUCCESS)
+            printf("Failed to create shader module\n");
 
-        VkCommandPoolCreateInfo transferCommandPoolInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-            .queueFamilyIndex = transferQueueFamilyIndex,
+        // Binding 0 is the mesh's uniform buffer for the frame; 1 to 3 are its meshlets, draw commands and draw count used by the culling pass.
+        std::array<VkDescriptorSetLayoutBinding, 4> layoutBindingInfos = {{
+            {
+                .binding = 0,
+                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+            },
+            {
+                .binding = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            },
+            {
+                .binding = 2,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            },
+            {
+                .binding = 3,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            },
+        }};
+
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .bindingCount = (uint32_t)layoutBindingInfos.size(),
+            .pBindings = layoutBindingInfos.data(),
+        };
+
+        descriptorSetLayouts.resize(settings.framesInFlight);
+
+        for (uint32_t i = 0; i < settings.framesInFlight; i++)
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutInfo, NULL, &descriptorSetLayouts[i]);
+
+        VkPushConstantRange pushConstantRange = {
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+            .offset = 0,
+            .size = sizeof(glm::vec3),
+        };
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = (uint32_t)descriptorSetLayouts.size(),
+            .pSetLayouts = descriptorSetLayouts.data(),
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &pushConstantRange,
+        };
+
+        vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipelineLayout);
+
+        // Meshlet culling pipeline creation.
+
+        VkPipelineLayoutCreateInfo cullPipelineLayoutInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = 1,
+            .pSetLayouts = &descriptorSetLayouts[0],
         };
 
-        if (vkCreateCommandPool(device, &transferCommandPoolInfo, NULL, &transferCommandPool) != VK_SUCCESS)
-            printf("Transfer command pool creation failed\n");
+        vkCreatePipelineLayout(device, &cullPipelineLayoutInfo, NULL, &cullPipelineLayout);
 
-        VkCommandBufferAllocateInfo commandBufferAllocInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .commandPool = commandPool,
-            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            .commandBufferCount = MAX_FRAMES_IN_FLIGHT,
+        VkComputePipelineCreateInfo cullPipelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = shaderModule,
+                .pName = "cullMeshlets",
+            },
+            .layout = cullPipelineLayout,
         };
 
-        commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &cullPipelineInfo, NULL, &cullPipeline) != VK_SUCCESS)
+            printf("Meshlet culling pipeline creation failed\n");
 
-        if (vkAllocateCommandBuffers(device, &commandBufferAllocInfo, commandBuffers.data()) != VK_SUCCESS)
-            printf("Failed to allocate command buffers\n");
+        // Recording threads, and command pool and command buffer creation. Each thread has a pool per frame in flight, which it records
+        // a secondary command buffer from; the render thread's also holds the frame's primary command buffer.
 
-        VkCommandBufferAllocateInfo transferCommandBufferAllocInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .commandPool = transferCommandPool,
-            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            .commandBufferCount = 1,
+        recordingThreads.start(settings.recordingThreads != 0 ? settings.recordingThreads : std::max(std::thread::hardware_concurrency(), 1u));
+
+        VkCommandPoolCreateInfo commandPoolInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = graphicsQueueFamilyIndex,
         };
 
-        if (vkAllocateCommandBuffers(device, &transferCommandBufferAllocInfo, &transferCommandBuffer) != VK_SUCCESS)
-            printf("Failed to allocate transfer command buffer\n");
+        frameCommandPools.resize(settings.framesInFlight * recordingThreads.getNumThreads());
+        commandBuffers.resize(settings.framesInFlight);
+
+        for (uint32_t i = 0; i < settings.framesInFlight; i++)
+        {
+            for (uint32_t j = 0; j < recordingThreads.getNumThreads(); j++)
+            {
+                FrameCommandPool &commandPool = getFrameCommandPool(i, j);
+
+                if (vkCreateCommandPool(device, &commandPoolInfo, NULL, &commandPool.pool) != VK_SUCCESS)
+                    printf("Command pool creation failed\n");
+
+                VkCommandBufferAllocateInfo secondaryAllocInfo = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                    .commandPool = commandPool.pool,
+                    .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                    .commandBufferCount = 1,
+                };
+
+                if (vkAllocateCommandBuffers(device, &secondaryAllocInfo, &commandPool.secondaryCommandBuffer) != VK_SUCCESS)
+                    printf("Failed to allocate secondary command buffers\n");
+            }
+
+            VkCommandBufferAllocateInfo commandBufferAllocInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = getFrameCommandPool(i, 0).pool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+            };
+
+            if (vkAllocateCommandBuffers(device, &commandBufferAllocInfo, &commandBuffers[i]) != VK_SUCCESS)
+                printf("Failed to allocate command buffers\n");
+        }
+
+        commandBufferCache.initialize(device, graphicsQueueFamilyIndex, settings.framesInFlight);
+
+        // Transfer command pool and command buffer creation. One command buffer per frame in flight, as the staging ring is.
+
+        if (transferQueue != NULL)
+        {
+            VkCommandPoolCreateInfo transferCommandPoolInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+                .queueFamilyIndex = transferQueueFamilyIndex,
+            };
+
+            if (vkCreateCommandPool(device, &transferCommandPoolInfo, NULL, &transferCommandPool) != VK_SUCCESS)
+                printf("Transfer command pool creation failed\n");
+
+            VkCommandBufferAllocateInfo transferCommandBufferAllocInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = transferCommandPool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = settings.framesInFlight,
+            };
+
+            transferCommandBuffers.resize(settings.framesInFlight);
+
+            if (vkAllocateCommandBuffers(device, &transferCommandBufferAllocInfo, transferCommandBuffers.data()) != VK_SUCCESS)
+                printf("Failed to allocate transfer command buffers\n");
+        }
+
+        // Geometry pages are created as meshes need them. On integrated GPUs device-local memory is also host-visible and as fast to
+        // write as a staging buffer, so meshes are written into it directly; elsewhere they are staged and copied.
+
+        geometryMemoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+        if (unifiedMemory)
+            geometryMemoryProperties |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+        geometryHeapIndex = memoryAllocator.getHeapIndex(geometryMemoryProperties);
+
+        // Staging ring creation.
+
+        createBuffer(STAGING_RING_FRAME_SIZE * settings.framesInFlight, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, GPU_MEMORY_STAGING, stagingRingBuffer, stagingRingAllocation);
+        stagingRing.initialize(stagingRingBuffer, stagingRingAllocation.mapped, STAGING_RING_FRAME_SIZE * settings.framesInFlight);
 
         // Create sync objects.
 
@@ -1452,30 +3621,44 @@ public:
             .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
         };
 
-        VkFenceCreateInfo fenceInfo = {
-            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-            .flags = VK_FENCE_CREATE_SIGNALED_BIT,
-        };
+        // Frames are paced by the graphics timeline. Swapchain images are only acquired and presented with binary semaphores: one per
+        // frame in flight for the acquire, free again once the frame that waited on it has finished, and one per image for the present,
+        // created with the swapchain.
 
-        presentCompleteSemaphores.resize(numSwapchainImages);
-        renderFinishedSemaphores.resize(numSwapchainImages);
-        inflightFences.resize(MAX_FRAMES_IN_FLIGHT);
+        if (frameScheduler.initialize(device, settings.framesInFlight) == false)
+            printf("Frame timeline semaphore creation failed\n");
 
-        for (uint32_t i = 0; i < numSwapchainImages; i++)
-        {
-            VkResult res1 = vkCreateSemaphore(device, &semaphoreInfo, NULL, &presentCompleteSemaphores[i]);
-            VkResult res2 = vkCreateSemaphore(device, &semaphoreInfo, NULL, &renderFinishedSemaphores[i]);
+        presentCompleteSemaphores.resize(settings.framesInFlight);
 
-            if ((res1 & res2) != VK_SUCCESS)
+        for (auto &semaphore : presentCompleteSemaphores)
+            if (vkCreateSemaphore(device, &semaphoreInfo, NULL, &semaphore) != VK_SUCCESS)
                 printf("Semaphore creation failed\n");
-        }
 
-        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-            if (vkCreateFence(device, &fenceInfo, NULL, &inflightFences[i]) != VK_SUCCESS)
-                printf("Fence creation failed\n");
+        VkSemaphoreTypeCreateInfo timelineTypeInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0,
+        };
+
+        VkSemaphoreCreateInfo timelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &timelineTypeInfo,
+        };
+
+        if (transferQueue != NULL && vkCreateSemaphore(device, &timelineInfo, NULL, &transferTimeline) != VK_SUCCESS)
+            printf("Transfer timeline semaphore creation failed\n");
+
+        // Frame graph images. Transient attachments are alive for the passes the graph declares them used in, which do not depend on
+        // the meshes.
 
-        transferData();
-        createDepthResources();
+        swapchainImageResource = frameGraph.addImage(VK_IMAGE_ASPECT_COLOR_BIT, false);
+        depthImageResource = frameGraph.addImage(VK_IMAGE_ASPECT_DEPTH_BIT, true);
+        buildFrameGraph(0, false);
+
+        transientAttachments.initialize(device, &memoryAllocator);
+        depthAttachment = transientAttachments.add(VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+                                                   frameGraph.getFirstPass(depthImageResource), frameGraph.getLastPass(depthImageResource));
+        transientAttachments.create(extent);
     }
 
     // MARK: Renderer: Init Vk
@@ -1576,6 +3759,7 @@ public:
             vkGetPhysicalDeviceQueueFamilyProperties2(physicalDeviceCandidate, &queueFamilyPropertyCount, queueFamilyProperties.data());
 
             graphicsQueueFamilyIndex = UINT32_MAX;
+            transferQueueFamilyIndex = UINT32_MAX;
 
             for (uint32_t i = 0; i < queueFamilyPropertyCount; i++)
             {
@@ -1611,9 +3795,55 @@ public:
             if ((graphicsQueueFamilyIndex != UINT32_MAX) && supportsVulkan1_4)
             {
                 physicalDevice = physicalDeviceCandidate;
+                unifiedMemory = physicalDeviceProperties.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU;
 
                 vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &physicalDeviceMemoryProperties);
 
+                uint32_t extensionPropertyCount = 0;
+                vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionPropertyCount, NULL);
+                std::vector<VkExtensionProperties> extensionProperties(extensionPropertyCount);
+                vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionPropertyCount, extensionProperties.data());
+
+                std::vector<const char *> enabledExtensions(requiredDeviceExtensions.begin(), requiredDeviceExtensions.end());
+
+                for (const auto &optionalExtension : optionalDeviceExtensions)
+                    for (const auto &extensionProperty : extensionProperties)
+                        if (strcmp(extensionProperty.extensionName, optionalExtension) == 0)
+                            enabledExtensions.push_back(optionalExtension);
+
+                auto isEnabled = [&](const char *name)
+                {
+                    return std::find_if(enabledExtensions.begin(), enabledExtensions.end(), [&](const char *extension)
+                                        { return strcmp(extension, name) == 0; }) != enabledExtensions.end();
+                };
+
+                memoryBudgetSupported = isEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+                // Present wait needs present ids, and both extensions only help with the features enabled.
+
+                VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+                };
+
+                VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+                    .pNext = &presentWaitFeatures,
+                };
+
+                VkPhysicalDeviceFeatures2 supportedFeatures = {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                    .pNext = &presentIdFeatures,
+                };
+
+                vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+
+                presentWaitSupported = isEnabled(VK_KHR_PRESENT_ID_EXTENSION_NAME) && isEnabled(VK_KHR_PRESENT_WAIT_EXTENSION_NAME) &&
+                                       presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+
+                if (presentWaitSupported == false)
+                    std::erase_if(enabledExtensions, [](const char *extension)
+                                  { return strcmp(extension, VK_KHR_PRESENT_ID_EXTENSION_NAME) == 0 || strcmp(extension, VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0; });
+
                 float queuePriorities = 0.0f;
                 VkDeviceQueueCreateInfo graphicsQueueInfo = {
                     .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
@@ -1634,8 +3864,12 @@ public:
                     transferQueueInfo,
                 };
 
+                // Without a transfer-only family, uploads are recorded on the graphics queue instead.
+                uint32_t deviceQueueInfoCount = transferQueueFamilyIndex != UINT32_MAX ? 2 : 1;
+
                 VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamicFeatures = {
                     .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT,
+                    .pNext = presentWaitSupported ? &presentIdFeatures : NULL,
                     .extendedDynamicState = VK_TRUE,
                 };
 
@@ -1645,9 +3879,16 @@ public:
                     .shaderDrawParameters = VK_TRUE,
                 };
 
+                VkPhysicalDeviceVulkan12Features deviceFeatures12 = {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+                    .pNext = &deviceFeatures11,
+                    .drawIndirectCount = VK_TRUE,
+                    .timelineSemaphore = VK_TRUE,
+                };
+
                 VkPhysicalDeviceVulkan13Features deviceFeatures13 = {
                     .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
-                    .pNext = &deviceFeatures11,
+                    .pNext = &deviceFeatures12,
                     .synchronization2 = VK_TRUE,
                     .dynamicRendering = VK_TRUE,
                 };
@@ -1660,15 +3901,18 @@ public:
                 VkDeviceCreateInfo deviceInfo = {
                     .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
                     .pNext = &features,
-                    .queueCreateInfoCount = (uint32_t)deviceQueueInfos.size(),
+                    .queueCreateInfoCount = deviceQueueInfoCount,
                     .pQueueCreateInfos = deviceQueueInfos.data(),
-                    .enabledExtensionCount = (uint32_t)requiredDeviceExtensions.size(),
-                    .ppEnabledExtensionNames = requiredDeviceExtensions.data(),
+                    .enabledExtensionCount = (uint32_t)enabledExtensions.size(),
+                    .ppEnabledExtensionNames = enabledExtensions.data(),
                 };
 
                 if (vkCreateDevice(physicalDevice, &deviceInfo, NULL, &device) != VK_SUCCESS)
                     printf("Failed to create logical device\n");
 
+                memoryAllocator.initialize(physicalDevice, device, physicalDeviceMemoryProperties.memoryProperties, memoryBudgetSupported);
+                framePacer.initialize(device, presentWaitSupported, settings.targetFrameTime, settings.minFrameTime, settings.lowLatency);
+
                 break;
             }
             else
@@ -1701,8 +3945,11 @@ private:
 
     // TODO: Replace with proper interface after factoring parent class out.
     WindowInterface *windowInterface = nullptr;
+    RendererSettings settings = {};
     std::atomic<bool> shouldDestruct = false;
     std::atomic<bool> canDestruct = false;
+    // Counts calls to `requestRedraw`. Starts at 1 so that the first frame is drawn.
+    std::atomic<uint64_t> redrawRequests = 1;
 
     VkInstance instance = NULL;
     VkDebugUtilsMessengerEXT messenger = NULL;
@@ -1711,6 +3958,13 @@ private:
     VkPhysicalDevice physicalDevice = NULL;
     VkDevice device = NULL;
     VkPhysicalDeviceMemoryProperties2 physicalDeviceMemoryProperties = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2};
+    GpuMemoryAllocator memoryAllocator = {};
+    // Whether device-local memory is system memory, as on integrated GPUs.
+    bool unifiedMemory = false;
+    // Whether heaps' budgets come from VK_EXT_memory_budget rather than their size.
+    bool memoryBudgetSupported = false;
+    // Whether frame pacing can tell when presents reach the display, through VK_KHR_present_id and VK_KHR_present_wait.
+    bool presentWaitSupported = false;
     uint32_t graphicsQueueFamilyIndex = UINT32_MAX;
     VkQueue graphicsQueue = NULL;
     uint32_t transferQueueFamilyIndex = UINT32_MAX;
@@ -1726,41 +3980,75 @@ private:
     VkExtent2D extent = {};
     VkExtent2D pendingExtent = {};
 
-    VkImage depthImage = NULL;
-    VkDeviceMemory depthImageMemory = NULL;
-    VkImageView depthImageView = NULL;
+    TransientAttachments transientAttachments = {};
+    uint32_t depthAttachment = 0;
 
     VkShaderModule shaderModule = NULL;
     VkPipelineLayout pipelineLayout = NULL;
-    VkPipeline pipeline = NULL;
-
-    VkCommandPool commandPool = NULL;
+    // One per vertex layout of the meshes loaded so far. Only the loader threads touch these; meshes carry their pipeline's handle.
+    std::vector<MeshPipeline> meshPipelines = {};
+    std::mutex meshPipelineMutex = {};
+    VkFormat meshPipelineColorFormat = VK_FORMAT_UNDEFINED;
+    VkPipelineLayout cullPipelineLayout = NULL;
+    VkPipeline cullPipeline = NULL;
+
+    RecordingThreads recordingThreads = {};
+    // By frame in flight, then by recording thread.
+    std::vector<FrameCommandPool> frameCommandPools = {};
     std::vector<VkCommandBuffer> commandBuffers = {};
+    CommandBufferCache commandBufferCache = {};
+    // What the cached command buffers were recorded from; see `canCacheCommandBuffers`.
+    std::vector<uint64_t> cachedDrawState = {};
     std::vector<VkSemaphore> presentCompleteSemaphores = {};
     std::vector<VkSemaphore> renderFinishedSemaphores = {};
-    std::vector<VkFence> inflightFences = {};
+    // Also counts the frames drawn so far, for telling how long ago a mesh was last in view.
+    FrameScheduler frameScheduler = {};
+    FramePacer framePacer = {};
+    // The per-frame resources of the frame being drawn, from `frameScheduler`.
     uint32_t currentFrame = 0;
-    uint32_t semaphoreIndex = 0;
-
-    VkCommandPool transferCommandPool = NULL;
-    VkCommandBuffer transferCommandBuffer = NULL;
 
-    VkDeviceMemory vertexBufferMemory = NULL;
-    VkBuffer vertexBuffer = NULL;
-    VkDeviceMemory indexBufferMemory = NULL;
-    VkBuffer indexBuffer = NULL;
-    VkDeviceMemory transferBufferMemory = NULL;
-    VkBuffer transferBuffer = NULL;
+    // Graphics queue barriers, tracked across frames in submission order.
+    BarrierTracker frameBarriers = {};
+    RenderGraph frameGraph = {};
+    uint32_t swapchainImageResource = 0;
+    uint32_t depthImageResource = 0;
 
-    std::vector<VkBuffer> uniformBuffers = {};
-    std::vector<VkDeviceMemory> uniformBuffersMemory = {};
-    std::vector<void *> uniformBuffersMapped = {};
+    VkCommandPool transferCommandPool = NULL;
+    std::vector<VkCommandBuffer> transferCommandBuffers = {};
+    BarrierTracker transferBarriers = {};
+    // Counts transfer submissions. Signaled by each, and waited on by the graphics submission that first uses what it uploaded.
+    VkSemaphore transferTimeline = NULL;
+    uint64_t transferTimelineValue = 0;
+    // The transfer submission that read each frame's share of the staging ring.
+    std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> frameTransferValues = {};
+    // The latest transfer submission whose geometry the graphics queue has acquired.
+    uint64_t acquiredTransferValue = 0;
+
+    // Vertices, indices and meshlets of the resident meshes, at the page and offsets in their `RenderMesh`. Destroyed pages are left
+    // empty for the next to take their place, so that meshes' page indices stay put. Only the render thread touches them.
+    struct GeometryPage
+    {
+        VkBuffer buffer = NULL;
+        GpuAllocation allocation = {};
+        BuddyRanges ranges = {};
+        uint32_t numMeshes = 0;
+    };
+
+    std::vector<GeometryPage> geometryPages = {};
+    VkMemoryPropertyFlags geometryMemoryProperties = 0;
+    uint32_t geometryHeapIndex = 0;
+    VkBuffer stagingRingBuffer = NULL;
+    GpuAllocation stagingRingAllocation = {};
+    StagingRing stagingRing = {};
 
     std::vector<VkDescriptorSetLayout> descriptorSetLayouts = {};
-    VkDescriptorPool descriptorPool = NULL;
-    std::vector<VkDescriptorSet> descriptorSets = {};
 
-    Obj stanfordBunny = Obj("./res/bunny.obj");
+    // Only the render thread touches `meshes`; loader threads hand theirs over through `loadedMeshes`.
+    std::vector<RenderMesh> meshes = {};
+    // Whether a mesh in view is waiting on an eviction that is yet to come to become resident.
+    bool residencyPending = false;
+    CompletionQueue<RenderMesh> loadedMeshes = {};
+    AssetLoader assetLoader = AssetLoader(ASSET_LOADER_THREADS);
 
     glm::vec3 cameraAngle = {};
 };
@@ -1770,7 +4058,7 @@ private:
 class Window : WindowInterface
 {
 public:
-    Window(HINSTANCE hInstance)
+    Window(HINSTANCE hInstance, const RendererSettings &settings) : settings(settings)
     {
         WNDCLASSEXA windowClassInfo = {
             .cbSize = sizeof(WNDCLASSEX),
@@ -1859,6 +4147,7 @@ public:
     HWND m_hWnd = NULL;
 
     HANDLE rendererThread = NULL;
+    RendererSettings settings = {};
     std::unique_ptr<Renderer> renderer = nullptr;
 };
 
@@ -1866,7 +4155,7 @@ DWORD createRendererThread(LPVOID lpParameter)
 {
     Window *window = (Window *)lpParameter;
 
-    window->renderer = std::move(std::make_unique<Renderer>((WindowInterface *)lpParameter));
+    window->renderer = std::move(std::make_unique<Renderer>((WindowInterface *)lpParameter, window->settings));
 
     window->renderer->mainLoop();
 
@@ -1877,14 +4166,93 @@ DWORD createRendererThread(LPVOID lpParameter)
 
 int main(int argc, char *argv[])
 {
-    Obj("res/bunny.obj");
-
     printf("Hello, World!\n");
 
+    RendererSettings settings = {};
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+        {
+            settings.framesInFlight = (uint32_t)atoi(argv[++i]);
+
+            if (settings.framesInFlight < 1 || settings.framesInFlight > MAX_FRAMES_IN_FLIGHT)
+            {
+                printf("Frames in flight must be between 1 and %u\n", MAX_FRAMES_IN_FLIGHT);
+                settings.framesInFlight = std::clamp(settings.framesInFlight, 1u, MAX_FRAMES_IN_FLIGHT);
+            }
+        }
+        else if (strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc)
+        {
+            const char *mode = argv[++i];
+
+            if (strcmp(mode, "fifo") == 0)
+                settings.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+            else if (strcmp(mode, "fifo-relaxed") == 0)
+                settings.presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            else if (strcmp(mode, "mailbox") == 0)
+                settings.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            else if (strcmp(mode, "immediate") == 0)
+                settings.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            else
+                printf("Unknown present mode %s, expected fifo, fifo-relaxed, mailbox or immediate\n", mode);
+        }
+        else if (strcmp(argv[i], "--swapchain-images") == 0 && i + 1 < argc)
+        {
+            settings.swapchainImages = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--target-fps") == 0 && i + 1 < argc)
+        {
+            double targetFps = atof(argv[++i]);
+            settings.targetFrameTime = targetFps > 0.0 ? 1.0 / targetFps : 0.0;
+        }
+        else if (strcmp(argv[i], "--low-latency") == 0)
+        {
+            settings.lowLatency = true;
+        }
+        else if (strcmp(argv[i], "--recording-threads") == 0 && i + 1 < argc)
+        {
+            settings.recordingThreads = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cache-command-buffers") == 0)
+        {
+            settings.cacheCommandBuffers = true;
+        }
+        else if (strcmp(argv[i], "--max-fps") == 0 && i + 1 < argc)
+        {
+            double maxFps = atof(argv[++i]);
+            settings.minFrameTime = maxFps > 0.0 ? 1.0 / maxFps : 0.0;
+        }
+        else if (strcmp(argv[i], "--render-on-demand") == 0)
+        {
+            settings.renderOnDemand = true;
+        }
+        else if (strcmp(argv[i], "--float-vertices") == 0)
+        {
+            settings.quantizeVertices = false;
+        }
+        else if (strcmp(argv[i], "--lod-error-threshold") == 0 && i + 1 < argc)
+        {
+            settings.lodErrorThreshold = (float)atof(argv[++i]);
+
+            if (settings.lodErrorThreshold <= 0.0f)
+            {
+                printf("LOD error threshold must be greater than 0\n");
+                settings.lodErrorThreshold = DEFAULT_LOD_ERROR_THRESHOLD;
+            }
+        }
+        else
+        {
+            printf("Unknown argument %s\n", argv[i]);
+        }
+    }
+
+    printf("Frames in flight: %u\n", settings.framesInFlight);
+
     HINSTANCE hInstance = NULL;
     GetModuleHandleExA(NULL, NULL, &hInstance);
 
-    Window window = Window(hInstance);
+    Window window = Window(hInstance, settings);
 
     MSG msg = {};
     while (GetMessageA(&msg, NULL, 0, 0) > 0)
@@ -0,0 +1,3399 @@
+#pragma once
+
+#include <windows.h>
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <vector>
+#include <chrono>
+#include <utility>
+#include <atomic>
+#include <thread>
+#include <bit>
+#include <algorithm>
+#include <functional>
+#include <charconv>
+#include <string>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <emmintrin.h>
+
+// MARK: Obj number parsing
+
+// Bytes of zeroed padding the parser expects after the end of any buffer it scans, so 16-byte SIMD loads never fault.
+const size_t OBJ_PARSE_PADDING = 16;
+
+// Every power of ten up to 10^22 is exactly representable as a double.
+const std::array<double, 23> exactPowersOfTen = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char *skipBlanks(const char *cursor)
+{
+    while (isBlank(*cursor))
+        cursor++;
+
+    return cursor;
+}
+
+// Returns the start of the line after the one containing `cursor`, or `end` on the last line.
+inline const char *nextLine(const char *cursor, const char *end)
+{
+    const char *newline = (const char *)memchr(cursor, '\n', end - cursor);
+
+    return newline == nullptr ? end : newline + 1;
+}
+
+// Counts consecutive ASCII digits starting at `cursor`, classifying 16 bytes per step.
+inline size_t countDigits(const char *cursor)
+{
+    const __m128i belowZero = _mm_set1_epi8('0' - 1);
+    const __m128i aboveNine = _mm_set1_epi8('9' + 1);
+
+    size_t count = 0;
+
+    while (true)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(cursor + count));
+        // Bytes above 0x7F compare as negative, so they fail the first test.
+        __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(chunk, belowZero), _mm_cmplt_epi8(chunk, aboveNine));
+        unsigned mask = (unsigned)_mm_movemask_epi8(isDigit);
+
+        if (mask != 0xFFFF)
+            return count + std::countr_one(mask);
+
+        count += 16;
+    }
+}
+
+// Converts exactly eight ASCII digits to their value with SWAR multiplies instead of eight dependent steps.
+inline uint32_t parseEightDigits(const char *cursor)
+{
+    uint64_t value = 0;
+    memcpy(&value, cursor, sizeof(value));
+
+    value = ((value & 0x0F0F0F0F0F0F0F0F) * 2561) >> 8;
+    value = ((value & 0x00FF00FF00FF00FF) * 6553601) >> 16;
+
+    return (uint32_t)(((value & 0x0000FFFF0000FFFF) * 42949672960001) >> 32);
+}
+
+// Appends `count` digits to `value`. The caller guarantees the result fits in 64 bits.
+inline uint64_t accumulateDigits(const char *cursor, size_t count, uint64_t value)
+{
+    while (count >= 8)
+    {
+        value = value * 100000000 + parseEightDigits(cursor);
+        cursor += 8;
+        count -= 8;
+    }
+
+    while (count > 0)
+    {
+        value = value * 10 + (uint64_t)(*cursor - '0');
+        cursor++;
+        count--;
+    }
+
+    return value;
+}
+
+// Parses `[+-]digits[.digits][(e|E)[+-]digits]` and returns the cursor past it, or `cursor` itself if there is no number.
+// Mantissas of up to 19 digits with small exponents take an exact double-precision path; everything else goes through `std::from_chars`.
+inline const char *parseFloat(const char *cursor, float &result)
+{
+    const char *start = cursor;
+    bool negative = *cursor == '-';
+
+    if (*cursor == '-' || *cursor == '+')
+        cursor++;
+
+    const char *integral = cursor;
+    size_t integralDigits = countDigits(integral);
+    cursor += integralDigits;
+
+    const char *fractional = cursor;
+    size_t fractionalDigits = 0;
+
+    if (*cursor == '.')
+    {
+        cursor++;
+        fractional = cursor;
+        fractionalDigits = countDigits(fractional);
+        cursor += fractionalDigits;
+    }
+
+    if (integralDigits + fractionalDigits == 0)
+        return start;
+
+    int64_t exponent = 0;
+    bool exact = integralDigits + fractionalDigits <= 19;
+
+    if (*cursor == 'e' || *cursor == 'E')
+    {
+        const char *exponentCursor = cursor + 1;
+        bool negativeExponent = *exponentCursor == '-';
+
+        if (*exponentCursor == '-' || *exponentCursor == '+')
+            exponentCursor++;
+
+        size_t exponentDigits = countDigits(exponentCursor);
+
+        // A bare `e` is not part of the number.
+        if (exponentDigits > 0)
+        {
+            if (exponentDigits > 9)
+                exact = false;
+            else
+                exponent = (int64_t)accumulateDigits(exponentCursor, exponentDigits, 0);
+
+            if (negativeExponent)
+                exponent = -exponent;
+
+            cursor = exponentCursor + exponentDigits;
+        }
+    }
+
+    if (exact)
+    {
+        uint64_t mantissa = accumulateDigits(fractional, fractionalDigits, accumulateDigits(integral, integralDigits, 0));
+        int64_t decimalExponent = exponent - (int64_t)fractionalDigits;
+
+        if (mantissa == 0)
+        {
+            result = negative ? -0.0f : 0.0f;
+            return cursor;
+        }
+
+        if (mantissa <= (1ull << 53) && decimalExponent >= -22 && decimalExponent <= 22)
+        {
+            // Both operands are exact, so the single multiply or divide is correctly rounded.
+            double value = (double)mantissa;
+
+            if (decimalExponent < 0)
+                value /= exactPowersOfTen[-decimalExponent];
+            else
+                value *= exactPowersOfTen[decimalExponent];
+
+            // Narrowing to float can only round differently from the exact decimal if the double landed on a float midpoint.
+            uint64_t bits = 0;
+            memcpy(&bits, &value, sizeof(bits));
+
+            if ((bits & 0x1FFFFFFF) != 0x10000000)
+            {
+                result = (float)(negative ? -value : value);
+                return cursor;
+            }
+        }
+    }
+
+    // `std::from_chars` rejects a leading plus.
+    auto [last, error] = std::from_chars(*start == '+' ? start + 1 : start, cursor, result);
+
+    // It also leaves the result untouched on overflow and underflow, where `strtof` saturates to infinity or zero.
+    if (error == std::errc::result_out_of_range)
+        result = strtof(std::string(start, cursor).c_str(), NULL);
+
+    return cursor;
+}
+
+// Parses `[-]digits` as a one-based OBJ index and resolves it to a zero-based one. Negative indices count back from the `count` elements seen so far.
+// Returns the cursor past the index, or `cursor` itself if there is no index.
+inline const char *parseIndex(const char *cursor, uint32_t count, uint32_t &result)
+{
+    bool negative = *cursor == '-';
+
+    if (negative)
+        cursor++;
+
+    size_t digits = countDigits(cursor);
+
+    if (digits == 0 || digits > 19)
+        return negative ? cursor - 1 : cursor;
+
+    uint64_t value = accumulateDigits(cursor, digits, 0);
+
+    result = negative ? (uint32_t)(count - value) : (uint32_t)(value - 1);
+
+    return cursor + digits;
+}
+
+// MARK: Threading helpers
+
+// Calls `function(threadIndex)` on `numThreads` threads, using the calling thread as thread 0, and returns once all of them have finished.
+template <typename Function>
+void runOnThreads(unsigned numThreads, Function function)
+{
+    std::vector<std::thread> workers;
+    workers.reserve(numThreads > 0 ? numThreads - 1 : 0);
+
+    for (unsigned i = 1; i < numThreads; i++)
+        workers.emplace_back(function, i);
+
+    function(0u);
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+// Splits [0, count) into `numThreads` contiguous slices and calls `function(begin, end)` on each slice in parallel.
+template <typename Function>
+void parallelFor(unsigned numThreads, size_t count, Function function)
+{
+    runOnThreads(numThreads, [&](unsigned threadIndex)
+                 { function(count * threadIndex / numThreads, count * (threadIndex + 1) / numThreads); });
+}
+
+// Caps a thread count so that every thread gets at least `minItemsPerThread` items.
+inline unsigned getUsefulThreadCount(unsigned numThreads, size_t count, size_t minItemsPerThread)
+{
+    return (unsigned)std::clamp<size_t>(count / minItemsPerThread, 1, std::max(numThreads, 1u));
+}
+
+// MARK: Mesh cache
+
+const uint32_t MESH_CACHE_MAGIC = 0x4853454D; // "MESH" when read as bytes.
+// Bump whenever the header or stream layout changes so stale caches are rebuilt.
+const uint32_t MESH_CACHE_VERSION = 7;
+const uint32_t MESH_CACHE_MAX_ATTRIBUTES = 4;
+const uint64_t MESH_CACHE_STREAM_ALIGNMENT = 64;
+
+// On-disk header of a `.meshcache` file. The vertex, index, group, meshlet and LOD streams follow at the recorded offsets, so a mapped file can be used in place.
+struct MeshCacheHeader
+{
+    uint32_t magic = MESH_CACHE_MAGIC;
+    uint32_t version = MESH_CACHE_VERSION;
+
+    // The cache is only valid for the exact source file it was built from.
+    char sourcePath[MAX_PATH] = {};
+    uint64_t sourceSize = 0;
+    uint64_t sourceWriteTime = 0;
+    // Whether the streams went through the mesh optimizer and the quantizer.
+    uint32_t optimized = 0;
+    uint32_t quantized = 0;
+    // The LOD chain was built with at most this many LODs.
+    uint32_t maxLods = 0;
+
+    uint64_t vertexOffset = 0;
+    uint64_t vertexDataSize = 0;
+    uint64_t indexOffset = 0;
+    uint64_t indexDataSize = 0;
+    uint64_t groupOffset = 0;
+    uint64_t groupDataSize = 0;
+    uint64_t meshletOffset = 0;
+    uint64_t meshletDataSize = 0;
+    uint64_t lodOffset = 0;
+    uint64_t lodDataSize = 0;
+    uint32_t numVertices = 0;
+    uint32_t numIndices = 0;
+    uint32_t numGroups = 0;
+    uint32_t numMeshlets = 0;
+    uint32_t numLods = 0;
+
+    float boundsMin[3] = {};
+    float boundsMax[3] = {};
+    float boundingSphere[4] = {};
+
+    uint32_t vertexAttributes = 0;
+    uint32_t indexType = VK_INDEX_TYPE_UINT32;
+    uint32_t vertexStride = 0;
+    uint32_t numAttributes = 0;
+    VkVertexInputAttributeDescription attributes[MESH_CACHE_MAX_ATTRIBUTES] = {};
+};
+
+// One `o`/`g`/`usemtl` range. Names and materials are offsets into the string data that follows the group records.
+struct MeshCacheGroup
+{
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t materialOffset;
+    uint32_t materialLength;
+    uint32_t firstIndex;
+    uint32_t numIndices;
+    uint32_t lod;
+};
+
+// Fills in the source path, size and last write time that key a cache file.
+inline bool getMeshCacheKey(const char *filename, MeshCacheHeader &header)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+
+    if (GetFileAttributesExA(filename, GetFileExInfoStandard, &attributes) == FALSE)
+        return false;
+
+    if (GetFullPathNameA(filename, MAX_PATH, header.sourcePath, NULL) == 0)
+        return false;
+
+    header.sourceSize = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    header.sourceWriteTime = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+
+    return true;
+}
+
+inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// MARK: Vertex deduplication
+
+// Marks a face tuple part that was left out (`v//vn`) or refers to nothing.
+const uint32_t OBJ_MISSING_INDEX = UINT32_MAX;
+
+// Fixed so the output does not depend on the thread count. Taken from the top bits of the hash.
+const uint32_t OBJ_DEDUP_SHARD_BITS = 6;
+const uint32_t OBJ_DEDUP_SHARDS = 1 << OBJ_DEDUP_SHARD_BITS;
+const size_t OBJ_DEDUP_MIN_CORNERS_PER_THREAD = 1 << 16;
+
+inline uint32_t hashCorner(uint32_t position, uint32_t texcoord, uint32_t normal)
+{
+    uint64_t hash = (position + 1) * 0x9E3779B97F4A7C15ull;
+    hash = (hash ^ texcoord) * 0xC2B2AE3D27D4EB4Full;
+    hash = (hash ^ normal) * 0x165667B19E3779F9ull;
+
+    return (uint32_t)(hash >> 32);
+}
+
+// One open-addressing slot: a corner tuple and the vertex it was assigned. 16 bytes, so four share a cache line.
+struct DedupSlot
+{
+    uint32_t position = 0;
+    uint32_t texcoord = 0;
+    uint32_t normal = 0;
+    uint32_t vertex = OBJ_MISSING_INDEX;
+};
+
+// Collapses identical (position, texcoord, normal) corners into unique vertices.
+// Corners are bucketed into shards by hash, and each shard gets its own linear-probing table owned by a single thread, so no locking is needed.
+// On return `indices[i]` is the vertex of corner `i`, numbered in order of first use, and `firstCorners[v]` is a corner that uses vertex `v`.
+inline void deduplicateCorners(const uint32_t *positions, const uint32_t *texcoords, const uint32_t *normals, size_t numCorners, unsigned numThreads, uint32_t *indices, std::vector<uint32_t> &firstCorners)
+{
+    numThreads = getUsefulThreadCount(numThreads, numCorners, OBJ_DEDUP_MIN_CORNERS_PER_THREAD);
+
+    std::vector<uint32_t> hashes(numCorners);
+    std::vector<std::array<size_t, OBJ_DEDUP_SHARDS>> shardOffsets(numThreads);
+
+    runOnThreads(numThreads, [&](unsigned threadIndex)
+                 {
+                     auto &histogram = shardOffsets[threadIndex];
+                     histogram.fill(0);
+
+                     for (size_t i = numCorners * threadIndex / numThreads; i < numCorners * (threadIndex + 1) / numThreads; i++)
+                     {
+                         hashes[i] = hashCorner(positions[i], texcoords[i], normals[i]);
+                         histogram[hashes[i] >> (32 - OBJ_DEDUP_SHARD_BITS)]++;
+                     } });
+
+    // Turn the per-thread histograms into scatter offsets, shard-major so every shard's corners end up contiguous and in file order.
+
+    std::array<size_t, OBJ_DEDUP_SHARDS + 1> shardBegin = {};
+    size_t offset = 0;
+
+    for (uint32_t shard = 0; shard < OBJ_DEDUP_SHARDS; shard++)
+    {
+        shardBegin[shard] = offset;
+
+        for (auto &histogram : shardOffsets)
+        {
+            size_t count = histogram[shard];
+            histogram[shard] = offset;
+            offset += count;
+        }
+    }
+
+    shardBegin[OBJ_DEDUP_SHARDS] = offset;
+
+    std::vector<uint32_t> order(numCorners);
+
+    runOnThreads(numThreads, [&](unsigned threadIndex)
+                 {
+                     auto &offsets = shardOffsets[threadIndex];
+
+                     for (size_t i = numCorners * threadIndex / numThreads; i < numCorners * (threadIndex + 1) / numThreads; i++)
+                         order[offsets[hashes[i] >> (32 - OBJ_DEDUP_SHARD_BITS)]++] = (uint32_t)i; });
+
+    // Insert each shard into its own table; `indices` temporarily holds shard-local vertex numbers.
+
+    std::array<uint32_t, OBJ_DEDUP_SHARDS + 1> shardVertexBase = {};
+    std::atomic<uint32_t> nextShard = 0;
+
+    runOnThreads(numThreads, [&](unsigned)
+                 {
+                     std::vector<DedupSlot> slots;
+
+                     for (uint32_t shard = nextShard++; shard < OBJ_DEDUP_SHARDS; shard = nextShard++)
+                     {
+                         size_t shardSize = shardBegin[shard + 1] - shardBegin[shard];
+                         size_t capacity = std::bit_ceil(std::max<size_t>(shardSize / 4, 16));
+                         uint32_t numVertices = 0;
+
+                         slots.assign(capacity, {});
+
+                         for (size_t j = shardBegin[shard]; j < shardBegin[shard + 1]; j++)
+                         {
+                             uint32_t corner = order[j];
+
+                             // Keep the load factor under a half so probe sequences stay short.
+                             if ((numVertices + 1) * 2 > capacity)
+                             {
+                                 std::vector<DedupSlot> grown(capacity * 2);
+
+                                 for (const auto &slot : slots)
+                                 {
+                                     if (slot.vertex == OBJ_MISSING_INDEX)
+                                         continue;
+
+                                     size_t index = hashCorner(slot.position, slot.texcoord, slot.normal) & (capacity * 2 - 1);
+
+                                     while (grown[index].vertex != OBJ_MISSING_INDEX)
+                                         index = (index + 1) & (capacity * 2 - 1);
+
+                                     grown[index] = slot;
+                                 }
+
+                                 slots = std::move(grown);
+                                 capacity *= 2;
+                             }
+
+                             size_t index = hashes[corner] & (capacity - 1);
+
+                             while (true)
+                             {
+                                 DedupSlot &slot = slots[index];
+
+                                 if (slot.vertex == OBJ_MISSING_INDEX)
+                                 {
+                                     slot = {positions[corner], texcoords[corner], normals[corner], numVertices++};
+                                     indices[corner] = slot.vertex;
+                                     break;
+                                 }
+
+                                 if (slot.position == positions[corner] && slot.texcoord == texcoords[corner] && slot.normal == normals[corner])
+                                 {
+                                     indices[corner] = slot.vertex;
+                                     break;
+                                 }
+
+                                 index = (index + 1) & (capacity - 1);
+                             }
+                         }
+
+                         shardVertexBase[shard + 1] = numVertices;
+                     } });
+
+    for (uint32_t shard = 0; shard < OBJ_DEDUP_SHARDS; shard++)
+        shardVertexBase[shard + 1] += shardVertexBase[shard];
+
+    // Renumber in order of first use so the vertex stream follows the index stream, whatever the shard layout was.
+
+    std::vector<uint32_t> renumbered(shardVertexBase[OBJ_DEDUP_SHARDS], OBJ_MISSING_INDEX);
+    firstCorners.resize(renumbered.size());
+    uint32_t nextVertex = 0;
+
+    for (size_t i = 0; i < numCorners; i++)
+    {
+        uint32_t &vertex = renumbered[shardVertexBase[hashes[i] >> (32 - OBJ_DEDUP_SHARD_BITS)] + indices[i]];
+
+        if (vertex == OBJ_MISSING_INDEX)
+        {
+            vertex = nextVertex++;
+            firstCorners[vertex] = (uint32_t)i;
+        }
+
+        indices[i] = vertex;
+    }
+}
+
+// MARK: Normals and bounds
+
+// Below these, a thread's share costs less than starting it.
+const size_t OBJ_NORMAL_MIN_TRIANGLES_PER_THREAD = 1 << 15;
+const size_t OBJ_BOUNDS_MIN_POSITIONS_PER_THREAD = 1 << 16;
+// Each thread accumulates into a buffer that spans only the positions its triangles use, which barely overlap in a typical file. If the
+// buffers would together be larger than this many times the position count, the faces are scattered and gathering is cheaper.
+const size_t OBJ_NORMAL_MAX_SPAN_RATIO = 2;
+
+// Loads three floats into the low lanes with a zero `w`, without reading past the third.
+inline __m128 loadFloat3(const float *values)
+{
+    return _mm_setr_ps(values[0], values[1], values[2], 0.0f);
+}
+
+inline void storeFloat3(float *values, __m128 vector)
+{
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, vector);
+    memcpy(values, lanes, sizeof(float) * 3);
+}
+
+// The cross product of the low three lanes, with a zero `w`.
+inline __m128 crossProduct(__m128 a, __m128 b)
+{
+    __m128 aYzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 bYzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 zxy = _mm_sub_ps(_mm_mul_ps(a, bYzx), _mm_mul_ps(aYzx, b));
+
+    return _mm_shuffle_ps(zxy, zxy, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// The sum of all four lanes, in every lane.
+inline __m128 horizontalSum(__m128 value)
+{
+    __m128 sums = _mm_add_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return _mm_add_ps(sums, _mm_shuffle_ps(sums, sums, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+// Unnormalized, the face normal's length is twice the triangle's area, which weights larger faces more.
+inline __m128 getFaceNormal(const float *positions, const uint32_t *triangle)
+{
+    __m128 positionA = loadFloat3(positions + (size_t)triangle[0] * 3);
+    __m128 positionB = loadFloat3(positions + (size_t)triangle[1] * 3);
+    __m128 positionC = loadFloat3(positions + (size_t)triangle[2] * 3);
+
+    return crossProduct(_mm_sub_ps(positionB, positionA), _mm_sub_ps(positionC, positionA));
+}
+
+// Smooth normals for triangles whose positions are too scattered to split the triangles between threads. The positions are split
+// instead: each thread sorts the corners of its share of the triangles into one bucket per range of positions, then takes a range, lists
+// the triangles around each of its positions from its bucket and sums their face normals. No two threads write the same value, and the
+// sums are added in triangle order, as one thread would.
+inline void gatherNormals(const float *positions, size_t numPositions, const uint32_t *corners, size_t numTriangles, unsigned numThreads, float *normals)
+{
+    auto getRange = [&](uint32_t position)
+    { return (unsigned)((uint64_t)position * numThreads / numPositions); };
+    auto getRangeBegin = [&](unsigned range)
+    { return (uint32_t)(((uint64_t)range * numPositions + numThreads - 1) / numThreads); };
+    auto isValid = [&](size_t triangle)
+    {
+        const uint32_t *corner = corners + triangle * 3;
+
+        return corner[0] < numPositions && corner[1] < numPositions && corner[2] < numPositions;
+    };
+
+    // Corners of valid triangles by the thread that sorts them and the range they fall in. `buckets` holds each range's corners
+    // contiguously, in corner order.
+    std::vector<uint32_t> bucketCounts((size_t)numThreads * numThreads, 0);
+    std::vector<uint32_t> buckets = {};
+
+    runOnThreads(numThreads, [&](unsigned threadIndex)
+                 {
+                     uint32_t *counts = bucketCounts.data() + (size_t)threadIndex * numThreads;
+                     size_t end = numTriangles * (threadIndex + 1) / numThreads;
+
+                     for (size_t i = numTriangles * threadIndex / numThreads; i < end; i++)
+                         if (isValid(i))
+                             for (size_t j = i * 3; j < i * 3 + 3; j++)
+                                 counts[getRange(corners[j])]++; });
+
+    std::vector<uint32_t> cursors((size_t)numThreads * numThreads);
+    uint32_t numBucketed = 0;
+
+    for (unsigned range = 0; range < numThreads; range++)
+    {
+        for (unsigned thread = 0; thread < numThreads; thread++)
+        {
+            cursors[(size_t)thread * numThreads + range] = numBucketed;
+            numBucketed += bucketCounts[(size_t)thread * numThreads + range];
+        }
+    }
+
+    buckets.resize(numBucketed);
+
+    runOnThreads(numThreads, [&](unsigned threadIndex)
+                 {
+                     uint32_t *threadCursors = cursors.data() + (size_t)threadIndex * numThreads;
+                     size_t end = numTriangles * (threadIndex + 1) / numThreads;
+
+                     for (size_t i = numTriangles * threadIndex / numThreads; i < end; i++)
+                         if (isValid(i))
+                             for (size_t j = i * 3; j < i * 3 + 3; j++)
+                                 buckets[threadCursors[getRange(corners[j])]++] = (uint32_t)j; });
+
+    // After sorting, every thread's last cursor for a range is where the next thread's corners for it start.
+    runOnThreads(numThreads, [&](unsigned threadIndex)
+                 {
+                     uint32_t begin = getRangeBegin(threadIndex);
+                     uint32_t end = getRangeBegin(threadIndex + 1);
+                     uint32_t bucketBegin = threadIndex > 0 ? cursors[(size_t)(numThreads - 1) * numThreads + threadIndex - 1] : 0;
+                     uint32_t bucketEnd = cursors[(size_t)(numThreads - 1) * numThreads + threadIndex];
+
+                     // Triangles around every position of the range, stored contiguously per position.
+
+                     std::vector<uint32_t> adjacencyOffsets(end - begin + 1, 0);
+
+                     for (uint32_t i = bucketBegin; i < bucketEnd; i++)
+                         adjacencyOffsets[corners[buckets[i]] - begin + 1]++;
+
+                     for (uint32_t position = 0; position < end - begin; position++)
+                         adjacencyOffsets[position + 1] += adjacencyOffsets[position];
+
+                     std::vector<uint32_t> adjacency(bucketEnd - bucketBegin);
+                     std::vector<uint32_t> adjacencyCursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+
+                     for (uint32_t i = bucketBegin; i < bucketEnd; i++)
+                         adjacency[adjacencyCursors[corners[buckets[i]] - begin]++] = buckets[i] / 3;
+
+                     for (uint32_t position = 0; position < end - begin; position++)
+                     {
+                         __m128 normal = _mm_setzero_ps();
+
+                         for (uint32_t k = adjacencyOffsets[position]; k < adjacencyOffsets[position + 1]; k++)
+                             normal = _mm_add_ps(normal, getFaceNormal(positions, corners + (size_t)adjacency[k] * 3));
+
+                         __m128 lengthSquared = horizontalSum(_mm_mul_ps(normal, normal));
+
+                         if (_mm_cvtss_f32(lengthSquared) > 0.0f)
+                             normal = _mm_div_ps(normal, _mm_sqrt_ps(lengthSquared));
+
+                         storeFloat3(normals + ((size_t)begin + position) * 3, normal);
+                     } });
+}
+
+// Computes the bounding box and sphere of `positions` and, unless `normals` is null, an area-weighted smooth normal for every position of
+// the fan-triangulated `corners`. Triangles are split across threads and each thread sums face normals into its own buffer, so no two
+// threads ever add to the same value; a parallel pass over the positions then adds up the buffers and accumulates the box. When the
+// buffers would overlap too much, `gatherNormals` computes the normals instead. Triangles with an out-of-range corner are skipped, and
+// positions no triangle with an area uses get a zero normal.
+inline void computeNormalsAndBounds(const float *positions, size_t numPositions, const uint32_t *corners, size_t numCorners, unsigned numThreads, float *normals, float boundsMin[3], float boundsMax[3], float boundingSphere[4])
+{
+    size_t numTriangles = normals != nullptr ? numCorners / 3 : 0;
+    unsigned numNormalThreads = getUsefulThreadCount(numThreads, numTriangles, OBJ_NORMAL_MIN_TRIANGLES_PER_THREAD);
+    std::vector<uint32_t> spanBegins(numNormalThreads, 0);
+    std::vector<uint32_t> spanEnds(numNormalThreads, 0);
+
+    auto findSpan = [&](size_t firstCorner, size_t endCorner, uint32_t &spanBegin, uint32_t &spanEnd)
+    {
+        uint32_t first = (uint32_t)numPositions;
+        uint32_t last = 0;
+
+        for (size_t i = firstCorner; i < endCorner; i++)
+        {
+            if (corners[i] < numPositions)
+            {
+                first = std::min(first, corners[i]);
+                last = std::max(last, corners[i] + 1);
+            }
+        }
+
+        spanBegin = std::min(first, last);
+        spanEnd = last;
+    };
+
+    runOnThreads(numNormalThreads, [&](unsigned threadIndex)
+                 { findSpan(numTriangles * threadIndex / numNormalThreads * 3, numTriangles * (threadIndex + 1) / numNormalThreads * 3, spanBegins[threadIndex], spanEnds[threadIndex]); });
+
+    size_t spanTotal = 0;
+
+    for (unsigned i = 0; i < numNormalThreads; i++)
+        spanTotal += spanEnds[i] - spanBegins[i];
+
+    bool gathered = numNormalThreads > 1 && spanTotal > OBJ_NORMAL_MAX_SPAN_RATIO * numPositions;
+
+    if (gathered)
+    {
+        gatherNormals(positions, numPositions, corners, numTriangles, numNormalThreads, normals);
+
+        numNormalThreads = 0;
+        spanBegins.clear();
+        spanEnds.clear();
+    }
+
+    std::vector<std::vector<__m128>> threadNormals(numNormalThreads);
+
+    if (numNormalThreads > 0)
+        runOnThreads(numNormalThreads, [&](unsigned threadIndex)
+                     {
+                         std::vector<__m128> &sums = threadNormals[threadIndex];
+                         uint32_t spanBegin = spanBegins[threadIndex];
+
+                         sums.assign(spanEnds[threadIndex] - spanBegin, _mm_setzero_ps());
+
+                         size_t endCorner = numTriangles * (threadIndex + 1) / numNormalThreads * 3;
+
+                         for (size_t i = numTriangles * threadIndex / numNormalThreads * 3; i < endCorner; i += 3)
+                         {
+                             uint32_t a = corners[i];
+                             uint32_t b = corners[i + 1];
+                             uint32_t c = corners[i + 2];
+
+                             if (a >= numPositions || b >= numPositions || c >= numPositions)
+                                 continue;
+
+                             __m128 faceNormal = getFaceNormal(positions, corners + i);
+
+                             sums[a - spanBegin] = _mm_add_ps(sums[a - spanBegin], faceNormal);
+                             sums[b - spanBegin] = _mm_add_ps(sums[b - spanBegin], faceNormal);
+                             sums[c - spanBegin] = _mm_add_ps(sums[c - spanBegin], faceNormal);
+                         } });
+
+    unsigned numBoundsThreads = getUsefulThreadCount(numThreads, numPositions, OBJ_BOUNDS_MIN_POSITIONS_PER_THREAD);
+    std::vector<__m128> threadMins(numBoundsThreads);
+    std::vector<__m128> threadMaxs(numBoundsThreads);
+
+    runOnThreads(numBoundsThreads, [&](unsigned threadIndex)
+                 {
+                     __m128 minimum = _mm_set1_ps(FLT_MAX);
+                     __m128 maximum = _mm_set1_ps(-FLT_MAX);
+                     size_t end = numPositions * (threadIndex + 1) / numBoundsThreads;
+
+                     for (size_t i = numPositions * threadIndex / numBoundsThreads; i < end; i++)
+                     {
+                         __m128 position = loadFloat3(positions + i * 3);
+
+                         minimum = _mm_min_ps(minimum, position);
+                         maximum = _mm_max_ps(maximum, position);
+
+                         if (normals == nullptr || gathered)
+                             continue;
+
+                         __m128 normal = _mm_setzero_ps();
+
+                         for (unsigned j = 0; j < numNormalThreads; j++)
+                             if (i >= spanBegins[j] && i < spanEnds[j])
+                                 normal = _mm_add_ps(normal, threadNormals[j][i - spanBegins[j]]);
+
+                         __m128 lengthSquared = horizontalSum(_mm_mul_ps(normal, normal));
+
+                         if (_mm_cvtss_f32(lengthSquared) > 0.0f)
+                             normal = _mm_div_ps(normal, _mm_sqrt_ps(lengthSquared));
+
+                         storeFloat3(normals + i * 3, normal);
+                     }
+
+                     threadMins[threadIndex] = minimum;
+                     threadMaxs[threadIndex] = maximum; });
+
+    __m128 minimum = threadMins[0];
+    __m128 maximum = threadMaxs[0];
+
+    for (unsigned i = 1; i < numBoundsThreads; i++)
+    {
+        minimum = _mm_min_ps(minimum, threadMins[i]);
+        maximum = _mm_max_ps(maximum, threadMaxs[i]);
+    }
+
+    if (numPositions == 0)
+    {
+        minimum = _mm_setzero_ps();
+        maximum = _mm_setzero_ps();
+    }
+
+    storeFloat3(boundsMin, minimum);
+    storeFloat3(boundsMax, maximum);
+
+    // Centred on the box rather than the minimal sphere, which is close for most meshes and needs no extra passes to find.
+    __m128 center = _mm_mul_ps(_mm_add_ps(minimum, maximum), _mm_set1_ps(0.5f));
+    std::vector<__m128> threadRadii(numBoundsThreads);
+
+    runOnThreads(numBoundsThreads, [&](unsigned threadIndex)
+                 {
+                     __m128 radiusSquared = _mm_setzero_ps();
+                     size_t end = numPositions * (threadIndex + 1) / numBoundsThreads;
+
+                     for (size_t i = numPositions * threadIndex / numBoundsThreads; i < end; i++)
+                     {
+                         __m128 offset = _mm_sub_ps(loadFloat3(positions + i * 3), center);
+                         radiusSquared = _mm_max_ps(radiusSquared, horizontalSum(_mm_mul_ps(offset, offset)));
+                     }
+
+                     threadRadii[threadIndex] = radiusSquared; });
+
+    __m128 radiusSquared = threadRadii[0];
+
+    for (unsigned i = 1; i < numBoundsThreads; i++)
+        radiusSquared = _mm_max_ps(radiusSquared, threadRadii[i]);
+
+    storeFloat3(boundingSphere, center);
+    boundingSphere[3] = sqrtf(_mm_cvtss_f32(radiusSquared));
+}
+
+// MARK: Mesh optimization
+
+// Post-transform cache size the optimizer targets and statistics are simulated with. 16 entries is at or below what current GPUs keep, so the ordering holds up everywhere.
+const uint32_t MESH_VERTEX_CACHE_SIZE = 16;
+// How much worse than its cluster's average ACMR a prefix may be and still be split off for overdraw sorting.
+const float MESH_OVERDRAW_THRESHOLD = 1.05f;
+
+struct VertexCacheStats
+{
+    // Average cache miss ratio: transformed vertices per triangle. 0.5 is the ideal for large closed meshes, 3 the worst case.
+    float acmr = 0.0f;
+    // Average transform to vertex ratio: transformed vertices per referenced vertex. 1 is ideal.
+    float atvr = 0.0f;
+};
+
+// Simulates a FIFO post-transform cache of MESH_VERTEX_CACHE_SIZE entries over the indices.
+inline VertexCacheStats analyzeVertexCache(const unsigned *indices, size_t numIndices, unsigned numVertices)
+{
+    std::vector<uint32_t> cacheTimestamps(numVertices, 0);
+    std::vector<uint8_t> referenced(numVertices, 0);
+    uint32_t timestamp = MESH_VERTEX_CACHE_SIZE + 1;
+    size_t numTransformed = 0;
+    size_t numReferenced = 0;
+
+    for (size_t i = 0; i < numIndices; i++)
+    {
+        unsigned vertex = indices[i];
+
+        if (timestamp - cacheTimestamps[vertex] > MESH_VERTEX_CACHE_SIZE)
+        {
+            cacheTimestamps[vertex] = timestamp++;
+            numTransformed++;
+        }
+
+        numReferenced += referenced[vertex] == 0;
+        referenced[vertex] = 1;
+    }
+
+    VertexCacheStats stats = {};
+
+    if (numIndices > 0)
+    {
+        stats.acmr = (float)numTransformed / (numIndices / 3);
+        stats.atvr = (float)numTransformed / numReferenced;
+    }
+
+    return stats;
+}
+
+// Reorders triangles for the post-transform cache with Tipsify (Sander, Nehab and Barczak 2007): fan around a vertex, then move on to the
+// neighbour that will still be cached after its own fan. `hardBoundaries` receives the first triangle of every run that starts after the
+// walk dead-ended and had to jump, which is where the overdraw pass may reorder freely.
+inline void optimizeVertexCache(unsigned *indices, size_t numIndices, unsigned numVertices, std::vector<size_t> &hardBoundaries)
+{
+    size_t numTriangles = numIndices / 3;
+
+    hardBoundaries.clear();
+
+    if (numTriangles == 0)
+        return;
+
+    // Triangles around every vertex, stored contiguously per vertex.
+
+    std::vector<uint32_t> adjacencyOffsets(numVertices + 1, 0);
+
+    for (size_t i = 0; i < numIndices; i++)
+        adjacencyOffsets[indices[i] + 1]++;
+
+    for (unsigned vertex = 0; vertex < numVertices; vertex++)
+        adjacencyOffsets[vertex + 1] += adjacencyOffsets[vertex];
+
+    std::vector<uint32_t> adjacency(numIndices);
+    std::vector<uint32_t> liveTriangles(numVertices);
+
+    for (unsigned vertex = 0; vertex < numVertices; vertex++)
+        liveTriangles[vertex] = adjacencyOffsets[vertex + 1] - adjacencyOffsets[vertex];
+
+    {
+        std::vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+
+        for (size_t i = 0; i < numIndices; i++)
+            adjacency[cursors[indices[i]]++] = (uint32_t)(i / 3);
+    }
+
+    std::vector<uint32_t> cacheTimestamps(numVertices, 0);
+    std::vector<uint8_t> emitted(numTriangles, 0);
+    std::vector<uint32_t> deadEndStack = {};
+    std::vector<uint32_t> candidates = {};
+    std::vector<unsigned> output = {};
+    output.reserve(numTriangles * 3);
+
+    uint32_t timestamp = MESH_VERTEX_CACHE_SIZE + 1;
+    unsigned vertexCursor = 0;
+    uint32_t fanning = indices[0];
+
+    // Called when no candidate would still be cached: prefer a recently emitted vertex, else the next vertex in index order with triangles left.
+    auto skipDeadEnd = [&]() -> uint32_t
+    {
+        while (deadEndStack.empty() == false)
+        {
+            uint32_t vertex = deadEndStack.back();
+            deadEndStack.pop_back();
+
+            if (liveTriangles[vertex] > 0)
+                return vertex;
+        }
+
+        for (; vertexCursor < numVertices; vertexCursor++)
+            if (liveTriangles[vertexCursor] > 0)
+                return vertexCursor;
+
+        return OBJ_MISSING_INDEX;
+    };
+
+    hardBoundaries.push_back(0);
+
+    while (fanning != OBJ_MISSING_INDEX)
+    {
+        candidates.clear();
+
+        for (uint32_t i = adjacencyOffsets[fanning]; i < adjacencyOffsets[fanning + 1]; i++)
+        {
+            uint32_t triangle = adjacency[i];
+
+            if (emitted[triangle])
+                continue;
+
+            emitted[triangle] = 1;
+
+            for (int corner = 0; corner < 3; corner++)
+            {
+                unsigned vertex = indices[triangle * 3 + corner];
+
+                output.push_back(vertex);
+                deadEndStack.push_back(vertex);
+                candidates.push_back(vertex);
+                liveTriangles[vertex]--;
+
+                if (timestamp - cacheTimestamps[vertex] > MESH_VERTEX_CACHE_SIZE)
+                    cacheTimestamps[vertex] = timestamp++;
+            }
+        }
+
+        // Pick the candidate that has been cached longest but will still be cached once its remaining triangles are emitted. As in
+        // Tipsify, any candidate with triangles left beats falling back to the dead-end stack, even one that would not stay cached.
+
+        uint32_t next = OBJ_MISSING_INDEX;
+        int64_t bestPriority = -1;
+
+        for (uint32_t vertex : candidates)
+        {
+            if (liveTriangles[vertex] == 0)
+                continue;
+
+            uint32_t age = timestamp - cacheTimestamps[vertex];
+            int64_t priority = age + 2 * liveTriangles[vertex] <= MESH_VERTEX_CACHE_SIZE ? age : 0;
+
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = vertex;
+            }
+        }
+
+        if (next == OBJ_MISSING_INDEX)
+        {
+            next = skipDeadEnd();
+
+            if (next != OBJ_MISSING_INDEX && output.size() / 3 > hardBoundaries.back())
+                hardBoundaries.push_back(output.size() / 3);
+        }
+
+        fanning = next;
+    }
+
+    memcpy(indices, output.data(), sizeof(unsigned) * numIndices);
+}
+
+// Splits the cache-ordered runs into smaller clusters where that costs little cache efficiency, then sorts the clusters so that those facing
+// away from the mesh centre are drawn first. Those are the most likely to be in front, so later clusters fail the depth test instead of
+// being shaded (Tipsify's linear-speed overdraw ordering).
+inline void optimizeOverdraw(unsigned *indices, size_t numIndices, const float *positions, unsigned numVertices, const std::vector<size_t> &hardBoundaries, float threshold)
+{
+    size_t numTriangles = numIndices / 3;
+
+    if (numTriangles == 0)
+        return;
+
+    // Soft boundaries: within each run, start a new cluster once the run so far has reached close to the run's own ACMR.
+
+    std::vector<uint32_t> cacheTimestamps(numVertices, 0);
+    uint32_t timestamp = MESH_VERTEX_CACHE_SIZE + 1;
+
+    auto countMisses = [&](size_t triangle)
+    {
+        size_t numMisses = 0;
+
+        for (int corner = 0; corner < 3; corner++)
+        {
+            unsigned vertex = indices[triangle * 3 + corner];
+
+            if (timestamp - cacheTimestamps[vertex] > MESH_VERTEX_CACHE_SIZE)
+            {
+                cacheTimestamps[vertex] = timestamp++;
+                numMisses++;
+            }
+        }
+
+        return numMisses;
+    };
+
+    // Moving the timestamp past the cache size empties the simulated cache.
+    auto flushCache = [&]()
+    {
+        timestamp += MESH_VERTEX_CACHE_SIZE + 1;
+    };
+
+    std::vector<size_t> clusterBegins = {};
+
+    for (size_t run = 0; run < hardBoundaries.size(); run++)
+    {
+        size_t runBegin = hardBoundaries[run];
+        size_t runEnd = run + 1 < hardBoundaries.size() ? hardBoundaries[run + 1] : numTriangles;
+        size_t numRunMisses = 0;
+
+        flushCache();
+
+        for (size_t triangle = runBegin; triangle < runEnd; triangle++)
+            numRunMisses += countMisses(triangle);
+
+        float runAcmr = (float)numRunMisses / (runEnd - runBegin);
+        size_t clusterBegin = runBegin;
+        size_t numClusterMisses = 0;
+
+        clusterBegins.push_back(runBegin);
+        flushCache();
+
+        for (size_t triangle = runBegin; triangle + 1 < runEnd; triangle++)
+        {
+            numClusterMisses += countMisses(triangle);
+
+            if (numClusterMisses <= (triangle + 1 - clusterBegin) * runAcmr * threshold)
+            {
+                clusterBegin = triangle + 1;
+                numClusterMisses = 0;
+                clusterBegins.push_back(clusterBegin);
+                flushCache();
+            }
+        }
+    }
+
+    // Sort by how much each cluster faces away from the centre of the mesh, using area-weighted centroids and normals.
+
+    size_t numClusters = clusterBegins.size();
+    std::vector<float> clusterCentroids(numClusters * 3, 0.0f);
+    std::vector<float> clusterNormals(numClusters * 3, 0.0f);
+    float meshCentroid[3] = {};
+    float meshArea = 0.0f;
+
+    for (size_t cluster = 0; cluster < numClusters; cluster++)
+    {
+        size_t clusterEnd = cluster + 1 < numClusters ? clusterBegins[cluster + 1] : numTriangles;
+        float *centroid = &clusterCentroids[cluster * 3];
+        float *normal = &clusterNormals[cluster * 3];
+        float clusterArea = 0.0f;
+
+        for (size_t triangle = clusterBegins[cluster]; triangle < clusterEnd; triangle++)
+        {
+            const float *p0 = &positions[indices[triangle * 3 + 0] * 3];
+            const float *p1 = &positions[indices[triangle * 3 + 1] * 3];
+            const float *p2 = &positions[indices[triangle * 3 + 2] * 3];
+
+            float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            float cross[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+            float area = sqrtf(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+
+            for (int i = 0; i < 3; i++)
+            {
+                centroid[i] += (p0[i] + p1[i] + p2[i]) / 3.0f * area;
+                normal[i] += cross[i];
+            }
+
+            clusterArea += area;
+        }
+
+        for (int i = 0; i < 3; i++)
+            meshCentroid[i] += centroid[i];
+
+        meshArea += clusterArea;
+
+        float invArea = clusterArea > 0.0f ? 1.0f / clusterArea : 0.0f;
+
+        for (int i = 0; i < 3; i++)
+            centroid[i] *= invArea;
+    }
+
+    for (int i = 0; i < 3; i++)
+        meshCentroid[i] = meshArea > 0.0f ? meshCentroid[i] / meshArea : 0.0f;
+
+    std::vector<float> sortKeys(numClusters);
+    std::vector<uint32_t> clusterOrder(numClusters);
+
+    for (size_t cluster = 0; cluster < numClusters; cluster++)
+    {
+        const float *centroid = &clusterCentroids[cluster * 3];
+        const float *normal = &clusterNormals[cluster * 3];
+        float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        float dot = 0.0f;
+
+        for (int i = 0; i < 3; i++)
+            dot += (centroid[i] - meshCentroid[i]) * normal[i];
+
+        sortKeys[cluster] = length > 0.0f ? dot / length : 0.0f;
+        clusterOrder[cluster] = (uint32_t)cluster;
+    }
+
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](uint32_t a, uint32_t b)
+                     { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<unsigned> sorted = {};
+    sorted.reserve(numIndices);
+
+    for (uint32_t cluster : clusterOrder)
+    {
+        size_t clusterEnd = cluster + 1 < numClusters ? clusterBegins[cluster + 1] : numTriangles;
+
+        sorted.insert(sorted.end(), indices + clusterBegins[cluster] * 3, indices + clusterEnd * 3);
+    }
+
+    memcpy(indices, sorted.data(), sizeof(unsigned) * numIndices);
+}
+
+// Renumbers vertices in the order the indices first reference them, so vertex fetches walk memory linearly, and drops unreferenced vertices.
+// Works in place on interleaved vertices of `stride` bytes and returns the new vertex count.
+inline unsigned optimizeVertexFetch(void *vertexData, uint32_t stride, unsigned numVertices, unsigned *indices, size_t numIndices)
+{
+    std::vector<uint32_t> remap(numVertices, OBJ_MISSING_INDEX);
+    std::vector<char> source((char *)vertexData, (char *)vertexData + (size_t)stride * numVertices);
+    unsigned numUsed = 0;
+
+    for (size_t i = 0; i < numIndices; i++)
+    {
+        uint32_t &vertex = remap[indices[i]];
+
+        if (vertex == OBJ_MISSING_INDEX)
+        {
+            vertex = numUsed++;
+            memcpy((char *)vertexData + (size_t)stride * vertex, &source[(size_t)stride * indices[i]], stride);
+        }
+
+        indices[i] = vertex;
+    }
+
+    return numUsed;
+}
+
+// MARK: Mesh simplification
+
+// Upper bound on the LOD chain, LOD 0 included.
+const unsigned MESH_MAX_LODS = 8;
+// Each LOD aims for this fraction of the previous LOD's triangles.
+const float MESH_LOD_REDUCTION = 0.5f;
+// The chain ends once a LOD keeps more than this fraction of the previous LOD's triangles, as it would cost memory for little gain.
+const float MESH_LOD_MIN_REDUCTION = 0.85f;
+// Largest deviation a LOD may have from LOD 0, relative to the largest extent of the mesh.
+const float MESH_LOD_MAX_ERROR = 0.05f;
+// Share of the cheapest collapse candidates each pass sorts and tries. Few more would succeed, as every collapse blocks its neighbourhood.
+const size_t MESH_SIMPLIFY_CANDIDATE_FRACTION = 4;
+// How strongly open borders resist moving away from their original line, relative to the surface around them.
+const double MESH_SIMPLIFY_BORDER_WEIGHT = 10.0;
+// A collapse is rejected if it rotates a neighbouring triangle's normal by more than about 75 degrees.
+const float MESH_SIMPLIFY_MAX_NORMAL_ROTATION = 0.25f;
+
+// Sum of squared distances to a set of weighted planes (Garland and Heckbert 1997), as a symmetric 4x4 matrix.
+struct Quadric
+{
+    double xx, yy, zz, xy, xz, yz, xw, yw, zw, ww;
+    double weight;
+};
+
+inline void addPlaneQuadric(Quadric &quadric, const double plane[4], double weight)
+{
+    quadric.xx += weight * plane[0] * plane[0];
+    quadric.yy += weight * plane[1] * plane[1];
+    quadric.zz += weight * plane[2] * plane[2];
+    quadric.xy += weight * plane[0] * plane[1];
+    quadric.xz += weight * plane[0] * plane[2];
+    quadric.yz += weight * plane[1] * plane[2];
+    quadric.xw += weight * plane[0] * plane[3];
+    quadric.yw += weight * plane[1] * plane[3];
+    quadric.zw += weight * plane[2] * plane[3];
+    quadric.ww += weight * plane[3] * plane[3];
+    quadric.weight += weight;
+}
+
+inline void addQuadric(Quadric &quadric, const Quadric &other)
+{
+    quadric.xx += other.xx;
+    quadric.yy += other.yy;
+    quadric.zz += other.zz;
+    quadric.xy += other.xy;
+    quadric.xz += other.xz;
+    quadric.yz += other.yz;
+    quadric.xw += other.xw;
+    quadric.yw += other.yw;
+    quadric.zw += other.zw;
+    quadric.ww += other.ww;
+    quadric.weight += other.weight;
+}
+
+// Weighted mean squared distance from `position` to the quadric's planes.
+inline double evaluateQuadric(const Quadric &quadric, const float position[3])
+{
+    if (quadric.weight <= 0.0)
+        return 0.0;
+
+    double x = position[0];
+    double y = position[1];
+    double z = position[2];
+
+    double sum = quadric.xx * x * x + quadric.yy * y * y + quadric.zz * z * z +
+                 2.0 * (quadric.xy * x * y + quadric.xz * x * z + quadric.yz * y * z) +
+                 2.0 * (quadric.xw * x + quadric.yw * y + quadric.zw * z) +
+                 quadric.ww;
+
+    return std::max(sum, 0.0) / quadric.weight;
+}
+
+enum SimplifyVertexKind : uint8_t
+{
+    // Surrounded by triangles; may collapse into any neighbour.
+    SIMPLIFY_VERTEX_MANIFOLD,
+    // On a single open border; may only collapse along it.
+    SIMPLIFY_VERTEX_BORDER,
+    // On an attribute seam, a group boundary or non-manifold geometry; never moves, but others may collapse into it.
+    SIMPLIFY_VERTEX_LOCKED,
+};
+
+// Simplifies a triangle list by quadric error edge collapses. Every collapse moves a vertex onto a neighbour, so the result only references
+// the original vertices and can share their buffer. `simplify` can be called repeatedly with falling targets, which keeps the accumulated
+// error of earlier calls and so yields a LOD chain from a single run.
+struct MeshSimplifier
+{
+    std::vector<unsigned> indices = {};
+    // The group of every triangle. Triangles never change group and keep their relative order.
+    std::vector<uint32_t> triangleGroups = {};
+    // Largest distance any collapse so far has moved the surface, in the units of the positions.
+    float error = 0.0f;
+
+    const float *vertexData = nullptr;
+    uint32_t stride = 0;
+    // Vertices that share a position share one id here, so topology is found across attribute seams.
+    std::vector<uint32_t> positionIds = {};
+    std::vector<SimplifyVertexKind> kinds = {};
+    // For border vertices, the position ids across the border edges leaving and entering the vertex.
+    std::vector<uint32_t> borderNext = {};
+    std::vector<uint32_t> borderPrevious = {};
+    std::vector<Quadric> quadrics = {};
+
+    // `vertexData` holds interleaved vertices of `stride` floats that start with the position.
+    MeshSimplifier(const unsigned *sourceIndices, size_t numIndices, const uint32_t *sourceGroups, const float *vertexData, uint32_t stride, unsigned numVertices)
+        : indices(sourceIndices, sourceIndices + numIndices - numIndices % 3), triangleGroups(sourceGroups, sourceGroups + numIndices / 3), vertexData(vertexData), stride(stride)
+    {
+        findPositionIds(numVertices);
+
+        std::vector<uint64_t> edges = getSortedEdges();
+
+        classifyVertices(numVertices, edges);
+        computeQuadrics(numVertices, edges);
+    }
+
+    size_t getNumTriangles()
+    {
+        return indices.size() / 3;
+    }
+
+    const float *getPosition(unsigned vertex)
+    {
+        return vertexData + (size_t)vertex * stride;
+    }
+
+    void findPositionIds(unsigned numVertices)
+    {
+        std::vector<uint32_t> order(numVertices);
+
+        for (unsigned vertex = 0; vertex < numVertices; vertex++)
+            order[vertex] = vertex;
+
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+                  { return memcmp(getPosition(a), getPosition(b), sizeof(float) * 3) < 0; });
+
+        positionIds.resize(numVertices);
+
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            bool samePosition = i > 0 && memcmp(getPosition(order[i]), getPosition(order[i - 1]), sizeof(float) * 3) == 0;
+
+            positionIds[order[i]] = samePosition ? positionIds[order[i - 1]] : order[i];
+        }
+    }
+
+    // Every triangle edge as `from << 32 | to` in position ids, sorted so that edges can be looked up.
+    std::vector<uint64_t> getSortedEdges()
+    {
+        std::vector<uint64_t> edges(indices.size());
+
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            uint32_t from = positionIds[indices[i]];
+            uint32_t to = positionIds[indices[i - i % 3 + (i + 1) % 3]];
+
+            edges[i] = (uint64_t)from << 32 | to;
+        }
+
+        std::sort(edges.begin(), edges.end());
+
+        return edges;
+    }
+
+    static bool isBorderEdge(const std::vector<uint64_t> &edges, uint32_t from, uint32_t to)
+    {
+        return std::binary_search(edges.begin(), edges.end(), (uint64_t)to << 32 | from) == false;
+    }
+
+    void classifyVertices(unsigned numVertices, const std::vector<uint64_t> &edges)
+    {
+        kinds.assign(numVertices, SIMPLIFY_VERTEX_MANIFOLD);
+        borderNext.assign(numVertices, OBJ_MISSING_INDEX);
+        borderPrevious.assign(numVertices, OBJ_MISSING_INDEX);
+
+        // Seams: a position used by more than one vertex. Group boundaries: a position used by more than one group.
+
+        std::vector<uint32_t> firstUsers(numVertices, OBJ_MISSING_INDEX);
+        std::vector<uint32_t> firstGroups(numVertices, OBJ_MISSING_INDEX);
+
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            uint32_t position = positionIds[indices[i]];
+            uint32_t group = triangleGroups[i / 3];
+
+            if (firstUsers[position] == OBJ_MISSING_INDEX)
+            {
+                firstUsers[position] = indices[i];
+                firstGroups[position] = group;
+            }
+            else if (firstUsers[position] != indices[i] || firstGroups[position] != group)
+            {
+                kinds[position] = SIMPLIFY_VERTEX_LOCKED;
+            }
+        }
+
+        // An edge used once is a border; one used more than once in the same direction is non-manifold.
+
+        std::vector<uint8_t> numBorderEdges(numVertices, 0);
+
+        for (size_t i = 0; i < edges.size(); i++)
+        {
+            uint32_t from = (uint32_t)(edges[i] >> 32);
+            uint32_t to = (uint32_t)edges[i];
+
+            if ((i + 1 < edges.size() && edges[i + 1] == edges[i]) || (i > 0 && edges[i - 1] == edges[i]))
+            {
+                kinds[from] = SIMPLIFY_VERTEX_LOCKED;
+                kinds[to] = SIMPLIFY_VERTEX_LOCKED;
+                continue;
+            }
+
+            if (from == to || isBorderEdge(edges, from, to) == false)
+                continue;
+
+            borderNext[from] = to;
+            borderPrevious[to] = from;
+            numBorderEdges[from] = (uint8_t)std::min(numBorderEdges[from] + 1, 255);
+            numBorderEdges[to] = (uint8_t)std::min(numBorderEdges[to] + 1, 255);
+        }
+
+        // A vertex where several borders meet could only move along one of them, so it is kept in place.
+        for (unsigned vertex = 0; vertex < numVertices; vertex++)
+        {
+            if (numBorderEdges[vertex] == 0 || kinds[vertex] == SIMPLIFY_VERTEX_LOCKED)
+                continue;
+
+            kinds[vertex] = numBorderEdges[vertex] == 2 ? SIMPLIFY_VERTEX_BORDER : SIMPLIFY_VERTEX_LOCKED;
+        }
+    }
+
+    // Every triangle adds its plane weighted by its area. Border edges add a plane through the edge perpendicular to the triangle, which
+    // keeps the outline in place.
+    void computeQuadrics(unsigned numVertices, const std::vector<uint64_t> &edges)
+    {
+        quadrics.assign(numVertices, {});
+
+        for (size_t triangle = 0; triangle < getNumTriangles(); triangle++)
+        {
+            const float *p[3] = {};
+
+            for (int corner = 0; corner < 3; corner++)
+                p[corner] = getPosition(indices[triangle * 3 + corner]);
+
+            double e1[3] = {};
+            double e2[3] = {};
+
+            for (int j = 0; j < 3; j++)
+            {
+                e1[j] = (double)p[1][j] - p[0][j];
+                e2[j] = (double)p[2][j] - p[0][j];
+            }
+
+            double normal[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+            double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+            if (length == 0.0)
+                continue;
+
+            for (int j = 0; j < 3; j++)
+                normal[j] /= length;
+
+            double plane[4] = {normal[0], normal[1], normal[2], -(normal[0] * p[0][0] + normal[1] * p[0][1] + normal[2] * p[0][2])};
+
+            for (int corner = 0; corner < 3; corner++)
+                addPlaneQuadric(quadrics[positionIds[indices[triangle * 3 + corner]]], plane, length * 0.5);
+
+            for (int corner = 0; corner < 3; corner++)
+            {
+                uint32_t from = positionIds[indices[triangle * 3 + corner]];
+                uint32_t to = positionIds[indices[triangle * 3 + (corner + 1) % 3]];
+
+                if (from == to || isBorderEdge(edges, from, to) == false)
+                    continue;
+
+                const float *a = p[corner];
+                const float *b = p[(corner + 1) % 3];
+                double edge[3] = {(double)b[0] - a[0], (double)b[1] - a[1], (double)b[2] - a[2]};
+                double edgeLengthSquared = edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2];
+                double borderNormal[3] = {edge[1] * normal[2] - edge[2] * normal[1], edge[2] * normal[0] - edge[0] * normal[2], edge[0] * normal[1] - edge[1] * normal[0]};
+                double borderLength = sqrt(borderNormal[0] * borderNormal[0] + borderNormal[1] * borderNormal[1] + borderNormal[2] * borderNormal[2]);
+
+                if (borderLength == 0.0)
+                    continue;
+
+                for (int j = 0; j < 3; j++)
+                    borderNormal[j] /= borderLength;
+
+                double borderPlane[4] = {borderNormal[0], borderNormal[1], borderNormal[2], -(borderNormal[0] * a[0] + borderNormal[1] * a[1] + borderNormal[2] * a[2])};
+
+                addPlaneQuadric(quadrics[from], borderPlane, edgeLengthSquared * MESH_SIMPLIFY_BORDER_WEIGHT);
+                addPlaneQuadric(quadrics[to], borderPlane, edgeLengthSquared * MESH_SIMPLIFY_BORDER_WEIGHT);
+            }
+        }
+    }
+
+    // Whether moving `from` onto `to` would turn any of the triangles around `from` that survive the collapse over.
+    bool collapseFlips(unsigned from, unsigned to, const std::vector<uint32_t> &adjacencyOffsets, const std::vector<uint32_t> &adjacency)
+    {
+        const float *target = getPosition(to);
+
+        for (uint32_t i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; i++)
+        {
+            const unsigned *triangle = &indices[adjacency[i] * 3];
+            const float *p[3] = {};
+            const float *q[3] = {};
+            bool removed = false;
+
+            for (int corner = 0; corner < 3; corner++)
+            {
+                removed |= positionIds[triangle[corner]] == positionIds[to];
+                p[corner] = getPosition(triangle[corner]);
+                q[corner] = triangle[corner] == from ? target : p[corner];
+            }
+
+            if (removed)
+                continue;
+
+            float before[3] = {};
+            float after[3] = {};
+
+            auto computeNormal = [](const float *const *v, float normal[3])
+            {
+                float e1[3] = {v[1][0] - v[0][0], v[1][1] - v[0][1], v[1][2] - v[0][2]};
+                float e2[3] = {v[2][0] - v[0][0], v[2][1] - v[0][1], v[2][2] - v[0][2]};
+
+                normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+                normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+                normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+            };
+
+            computeNormal(p, before);
+            computeNormal(q, after);
+
+            float dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+            float lengths = sqrtf((before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) * (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]));
+
+            if (dot <= MESH_SIMPLIFY_MAX_NORMAL_ROTATION * lengths)
+                return true;
+        }
+
+        return false;
+    }
+
+    // Collapses edges, cheapest first, until at most `targetTriangles` remain or every remaining collapse would move the surface by more
+    // than `maxError`. Each pass collapses a set of edges that do not touch each other, so their costs stay exact, then rebuilds.
+    void simplify(size_t targetTriangles, float maxError)
+    {
+        struct Collapse
+        {
+            double cost;
+            uint32_t from;
+            uint32_t to;
+        };
+
+        unsigned numVertices = (unsigned)positionIds.size();
+        double maxCost = (double)maxError * maxError;
+        std::vector<uint32_t> adjacencyOffsets(numVertices + 1);
+        std::vector<uint32_t> adjacency = {};
+        std::vector<Collapse> collapses = {};
+        std::vector<uint32_t> remap(numVertices);
+        std::vector<uint8_t> touched(numVertices);
+
+        while (getNumTriangles() > targetTriangles)
+        {
+            // Triangles around every vertex, stored contiguously per vertex.
+
+            std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+
+            for (unsigned vertex : indices)
+                adjacencyOffsets[vertex + 1]++;
+
+            for (unsigned vertex = 0; vertex < numVertices; vertex++)
+                adjacencyOffsets[vertex + 1] += adjacencyOffsets[vertex];
+
+            adjacency.resize(indices.size());
+
+            {
+                std::vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+
+                for (size_t i = 0; i < indices.size(); i++)
+                    adjacency[cursors[indices[i]]++] = (uint32_t)(i / 3);
+            }
+
+            // Both directions of every edge are candidates. Interior edges show up in two triangles and are only taken from one of them.
+
+            collapses.clear();
+
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                unsigned a = indices[i];
+                unsigned b = indices[i - i % 3 + (i + 1) % 3];
+                uint32_t aId = positionIds[a];
+                uint32_t bId = positionIds[b];
+                bool border = (kinds[aId] == SIMPLIFY_VERTEX_BORDER && borderNext[aId] == bId) || (kinds[bId] == SIMPLIFY_VERTEX_BORDER && borderPrevious[bId] == aId);
+
+                if (aId > bId && border == false)
+                    continue;
+
+                for (auto [from, to] : {std::pair(a, b), std::pair(b, a)})
+                {
+                    uint32_t fromId = positionIds[from];
+                    uint32_t toId = positionIds[to];
+
+                    if (fromId == toId || kinds[fromId] == SIMPLIFY_VERTEX_LOCKED)
+                        continue;
+
+                    // Along the border only, and never across a border that has shrunk to two edges.
+                    if (kinds[fromId] == SIMPLIFY_VERTEX_BORDER && ((toId != borderNext[fromId] && toId != borderPrevious[fromId]) || borderNext[fromId] == borderPrevious[fromId]))
+                        continue;
+
+                    Quadric quadric = quadrics[fromId];
+                    addQuadric(quadric, quadrics[toId]);
+
+                    collapses.push_back({.cost = evaluateQuadric(quadric, getPosition(to)), .from = from, .to = to});
+                }
+            }
+
+            auto sortEnd = collapses.begin() + collapses.size() / MESH_SIMPLIFY_CANDIDATE_FRACTION + 1;
+            auto compareCost = [](const Collapse &a, const Collapse &b)
+            {
+                return a.cost < b.cost;
+            };
+
+            if (collapses.size() > 1)
+            {
+                std::nth_element(collapses.begin(), sortEnd, collapses.end(), compareCost);
+                std::sort(collapses.begin(), sortEnd, compareCost);
+                collapses.erase(sortEnd, collapses.end());
+            }
+
+            for (unsigned vertex = 0; vertex < numVertices; vertex++)
+                remap[vertex] = vertex;
+
+            std::fill(touched.begin(), touched.end(), 0);
+
+            size_t numRemaining = getNumTriangles();
+            size_t numCollapsed = 0;
+
+            for (const auto &collapse : collapses)
+            {
+                if (numRemaining <= targetTriangles || collapse.cost > maxCost)
+                    break;
+
+                uint32_t fromId = positionIds[collapse.from];
+                uint32_t toId = positionIds[collapse.to];
+
+                if (touched[fromId] || touched[toId] || collapseFlips(collapse.from, collapse.to, adjacencyOffsets, adjacency))
+                    continue;
+
+                // A vertex that may move is never on a seam, so `from` is the only vertex at its position and every triangle around it takes
+                // the same vertex at `to`: the one this edge was found with.
+                remap[collapse.from] = collapse.to;
+                addQuadric(quadrics[toId], quadrics[fromId]);
+
+                if (kinds[fromId] == SIMPLIFY_VERTEX_BORDER)
+                {
+                    uint32_t other = toId == borderNext[fromId] ? borderPrevious[fromId] : borderNext[fromId];
+
+                    if (toId == borderNext[fromId])
+                    {
+                        borderNext[other] = toId;
+                        borderPrevious[toId] = other;
+                    }
+                    else
+                    {
+                        borderPrevious[other] = toId;
+                        borderNext[toId] = other;
+                    }
+                }
+
+                for (uint32_t i = adjacencyOffsets[collapse.from]; i < adjacencyOffsets[collapse.from + 1]; i++)
+                {
+                    const unsigned *triangle = &indices[adjacency[i] * 3];
+                    bool removed = false;
+
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        touched[positionIds[triangle[corner]]] = 1;
+                        removed |= positionIds[triangle[corner]] == toId;
+                    }
+
+                    numRemaining -= removed;
+                }
+
+                error = std::max(error, (float)sqrt(collapse.cost));
+                numCollapsed++;
+            }
+
+            if (numCollapsed == 0)
+                break;
+
+            // Drop the triangles that lost an edge, keeping the order of the rest.
+
+            size_t numKept = 0;
+
+            for (size_t triangle = 0; triangle < getNumTriangles(); triangle++)
+            {
+                unsigned a = remap[indices[triangle * 3 + 0]];
+                unsigned b = remap[indices[triangle * 3 + 1]];
+                unsigned c = remap[indices[triangle * 3 + 2]];
+
+                if (positionIds[a] == positionIds[b] || positionIds[b] == positionIds[c] || positionIds[c] == positionIds[a])
+                    continue;
+
+                indices[numKept * 3 + 0] = a;
+                indices[numKept * 3 + 1] = b;
+                indices[numKept * 3 + 2] = c;
+                triangleGroups[numKept] = triangleGroups[triangle];
+                numKept++;
+            }
+
+            indices.resize(numKept * 3);
+            triangleGroups.resize(numKept);
+        }
+    }
+};
+
+// MARK: Vertex quantization
+
+// Rounds to the nearest half-precision value, ties to even. Overflow becomes infinity and NaN stays NaN.
+inline uint16_t floatToHalf(float value)
+{
+    uint32_t bits = std::bit_cast<uint32_t>(value);
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+
+    if (magnitude >= 0x7F800000)
+        return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0);
+
+    // At or above 65520, which rounds past the largest half (65504).
+    if (magnitude >= 0x477FF000)
+        return sign | 0x7C00;
+
+    // Below the smallest normal half (2^-14), count in units of the smallest subnormal (2^-24) and let the FPU round.
+    if (magnitude < 0x38800000)
+        return sign | (uint16_t)lrintf(std::bit_cast<float>(magnitude) * 16777216.0f);
+
+    // Rebias the exponent from 127 to 15 and drop 13 mantissa bits.
+    uint32_t result = (magnitude - 0x38000000) >> 13;
+    uint32_t remainder = magnitude & 0x1FFF;
+
+    if (remainder > 0x1000 || (remainder == 0x1000 && (result & 1)))
+        result++;
+
+    return sign | (uint16_t)result;
+}
+
+// Maps a unit vector onto the octahedron |x| + |y| + |z| = 1 and unfolds the lower half over the corners, giving two snorm16 values.
+// Decoded by `decodeOctahedral` in shader.slang. A zero vector encodes as +Z.
+inline void encodeOctahedral(const float normal[3], int16_t encoded[2])
+{
+    float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+
+    if (length == 0.0f)
+    {
+        encoded[0] = 0;
+        encoded[1] = 0;
+        return;
+    }
+
+    float x = normal[0] / length;
+    float y = normal[1] / length;
+
+    if (normal[2] < 0.0f)
+    {
+        float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+
+        x = foldedX;
+        y = foldedY;
+    }
+
+    encoded[0] = (int16_t)lrintf(std::clamp(x, -1.0f, 1.0f) * 32767.0f);
+    encoded[1] = (int16_t)lrintf(std::clamp(y, -1.0f, 1.0f) * 32767.0f);
+}
+
+// Maps `value` in [offset, offset + scale] to unorm16, the inverse of the shader's `pos * positionScale + positionOffset`.
+inline uint16_t quantizeUnorm16(float value, float offset, float scale)
+{
+    if (scale <= 0.0f)
+        return 0;
+
+    return (uint16_t)lrintf(std::clamp((value - offset) / scale, 0.0f, 1.0f) * 65535.0f);
+}
+
+// MARK: Meshlets
+
+// Small enough that a meshlet's vertices stay in the post-transform cache and its bounds stay tight, as in common mesh shading limits.
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// A contiguous run of triangles in the index buffer with the bounds the culling pass tests. Laid out to match `Meshlet` in shader.slang
+// under std430, which pads the struct to 16 bytes.
+struct Meshlet
+{
+    float center[3];
+    float radius;
+    // Every triangle in the meshlet faces away from a viewer for whom dot(center - viewer, coneAxis) >= coneCutoff * |center - viewer| + radius.
+    float coneAxis[3];
+    float coneCutoff;
+    uint32_t firstIndex;
+    uint32_t numIndices;
+    uint32_t padding[2];
+};
+
+static_assert(sizeof(Meshlet) == 48);
+
+// Computes a bounding sphere around the triangles' vertices and a cone containing their normals.
+inline void computeMeshletBounds(Meshlet &meshlet, const unsigned *indices, const float *vertexData, uint32_t stride)
+{
+    float boundsMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float boundsMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    for (uint32_t i = 0; i < meshlet.numIndices; i++)
+    {
+        const float *position = vertexData + (size_t)indices[meshlet.firstIndex + i] * stride;
+
+        for (int j = 0; j < 3; j++)
+        {
+            boundsMin[j] = std::min(boundsMin[j], position[j]);
+            boundsMax[j] = std::max(boundsMax[j], position[j]);
+        }
+    }
+
+    float radiusSquared = 0.0f;
+
+    for (int j = 0; j < 3; j++)
+        meshlet.center[j] = (boundsMin[j] + boundsMax[j]) * 0.5f;
+
+    for (uint32_t i = 0; i < meshlet.numIndices; i++)
+    {
+        const float *position = vertexData + (size_t)indices[meshlet.firstIndex + i] * stride;
+        float distanceSquared = 0.0f;
+
+        for (int j = 0; j < 3; j++)
+            distanceSquared += (position[j] - meshlet.center[j]) * (position[j] - meshlet.center[j]);
+
+        radiusSquared = std::max(radiusSquared, distanceSquared);
+    }
+
+    meshlet.radius = sqrtf(radiusSquared);
+
+    // The cone axis is the average unit normal; the cutoff follows from the normal furthest from it.
+
+    uint32_t numTriangles = meshlet.numIndices / 3;
+    std::vector<float> normals(numTriangles * 3, 0.0f);
+    float axis[3] = {};
+
+    for (uint32_t triangle = 0; triangle < numTriangles; triangle++)
+    {
+        const float *p0 = vertexData + (size_t)indices[meshlet.firstIndex + triangle * 3 + 0] * stride;
+        const float *p1 = vertexData + (size_t)indices[meshlet.firstIndex + triangle * 3 + 1] * stride;
+        const float *p2 = vertexData + (size_t)indices[meshlet.firstIndex + triangle * 3 + 2] * stride;
+
+        float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        float *normal = &normals[triangle * 3];
+
+        normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+        float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+        // Degenerate triangles have no facing and are left out of the cone.
+        if (length == 0.0f)
+            continue;
+
+        for (int j = 0; j < 3; j++)
+        {
+            normal[j] /= length;
+            axis[j] += normal[j];
+        }
+    }
+
+    float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    float minDot = 1.0f;
+
+    for (int j = 0; j < 3; j++)
+        meshlet.coneAxis[j] = axisLength > 0.0f ? axis[j] / axisLength : 0.0f;
+
+    for (uint32_t triangle = 0; triangle < numTriangles; triangle++)
+    {
+        const float *normal = &normals[triangle * 3];
+
+        if (normal[0] == 0.0f && normal[1] == 0.0f && normal[2] == 0.0f)
+            continue;
+
+        minDot = std::min(minDot, normal[0] * meshlet.coneAxis[0] + normal[1] * meshlet.coneAxis[1] + normal[2] * meshlet.coneAxis[2]);
+    }
+
+    // A cone of half a sphere or more always has a triangle facing the viewer, and a cutoff of 1 makes the test impossible to pass.
+    meshlet.coneCutoff = axisLength > 0.0f && minDot > 0.0f ? sqrtf(1.0f - minDot * minDot) : 1.0f;
+}
+
+// Splits [firstIndex, firstIndex + numIndices) into meshlets in index order, starting a new one whenever a triangle would exceed either limit.
+// Relies on the indices already being ordered for locality, which the vertex cache optimization provides. `vertexMeshlets` holds, per
+// vertex, the last meshlet that used it and must start out as OBJ_MISSING_INDEX.
+inline void buildMeshlets(const unsigned *indices, unsigned firstIndex, unsigned numIndices, const float *vertexData, uint32_t stride, std::vector<uint32_t> &vertexMeshlets, std::vector<Meshlet> &meshlets)
+{
+    Meshlet meshlet = {.firstIndex = firstIndex};
+    uint32_t numMeshletVertices = 0;
+    uint32_t meshletId = (uint32_t)meshlets.size();
+
+    auto finishMeshlet = [&]()
+    {
+        if (meshlet.numIndices == 0)
+            return;
+
+        computeMeshletBounds(meshlet, indices, vertexData, stride);
+        meshlets.push_back(meshlet);
+
+        meshlet = {.firstIndex = meshlet.firstIndex + meshlet.numIndices};
+        numMeshletVertices = 0;
+        meshletId++;
+    };
+
+    for (unsigned i = firstIndex; i + 2 < firstIndex + numIndices; i += 3)
+    {
+        const unsigned *triangle = indices + i;
+
+        auto countNewVertices = [&]()
+        {
+            return (uint32_t)(vertexMeshlets[triangle[0]] != meshletId) +
+                   (uint32_t)(vertexMeshlets[triangle[1]] != meshletId && triangle[1] != triangle[0]) +
+                   (uint32_t)(vertexMeshlets[triangle[2]] != meshletId && triangle[2] != triangle[0] && triangle[2] != triangle[1]);
+        };
+
+        if (numMeshletVertices + countNewVertices() > MESHLET_MAX_VERTICES || meshlet.numIndices / 3 + 1 > MESHLET_MAX_TRIANGLES)
+            finishMeshlet();
+
+        numMeshletVertices += countNewVertices();
+
+        for (int corner = 0; corner < 3; corner++)
+            vertexMeshlets[triangle[corner]] = meshletId;
+
+        meshlet.numIndices += 3;
+    }
+
+    finishMeshlet();
+}
+
+// MARK: Obj loader
+
+// Files are only split across threads once every chunk would get at least this many bytes.
+const size_t OBJ_MIN_CHUNK_SIZE = 1 << 20;
+const size_t OBJ_MIN_VERTICES_PER_THREAD = 1 << 16;
+
+// Vertex attributes present alongside the position, in the order they are interleaved.
+enum ObjAttributeBits : uint32_t
+{
+    OBJ_ATTRIBUTE_NORMAL_BIT = 0x1,
+    OBJ_ATTRIBUTE_TEXCOORD_BIT = 0x2,
+};
+
+// Reports how much of the source file has been consumed. Called on the loading thread after every read window.
+typedef void (*ObjProgressCallback)(uint64_t bytesRead, uint64_t totalBytes, void *pUserData);
+
+struct ObjLoadInfo
+{
+    // 1 parses serially; otherwise each read window is split into at most this many chunks that are counted and parsed in parallel.
+    unsigned numThreads = std::thread::hardware_concurrency();
+    // Bytes of source text held in memory at once. Grows only if a single line does not fit.
+    size_t windowSize = 64 << 20;
+    // Reorders triangles and vertices for the vertex cache, overdraw and vertex fetch after parsing. The cache keeps the reordered mesh.
+    bool optimizeMesh = true;
+    // Stores positions as unorm16 within the bounds, normals octahedral-encoded as snorm16 and texcoords as half floats, and switches to
+    // 16-bit indices when every vertex is addressable. Shaders decode positions with `getPositionDecode`.
+    bool quantizeVertices = false;
+    // Simplifies the mesh into a chain of up to this many LODs, LOD 0 being the original. 1 keeps only the original.
+    unsigned maxLods = MESH_MAX_LODS;
+    // Maps a valid `.meshcache` instead of parsing and writes one after parsing. Off to always measure the full load.
+    bool useCache = true;
+    ObjProgressCallback pfnProgress = nullptr;
+    void *pUserData = nullptr;
+};
+
+// Where the time of a load went, in seconds. Stages that did not run stay 0.
+struct ObjLoadTimings
+{
+    double read = 0.0;
+    double count = 0.0;
+    double parse = 0.0;
+    // Generating missing normals and computing the bounds.
+    double normals = 0.0;
+    // Gathering the windows, resolving the corners and deduplicating vertices.
+    double build = 0.0;
+    double simplify = 0.0;
+    double optimize = 0.0;
+    double meshlets = 0.0;
+    double quantize = 0.0;
+    // Mapping or writing the `.meshcache`.
+    double cache = 0.0;
+    double total = 0.0;
+};
+
+inline double getSecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// A run of consecutive indices that share an `o`/`g` name and a `usemtl` material. Every LOD has its own runs, in the same order.
+struct ObjGroup
+{
+    std::string name = {};
+    std::string material = {};
+    unsigned firstIndex = 0;
+    unsigned numIndices = 0;
+    unsigned lod = 0;
+};
+
+// One level of detail: a range of the index buffer and the meshlets that cover it. All LODs draw from the same vertices.
+struct ObjLod
+{
+    uint32_t firstIndex;
+    uint32_t numIndices;
+    uint32_t firstMeshlet;
+    uint32_t numMeshlets;
+    // Largest distance the simplifier moved the surface away from LOD 0, in object space.
+    float error;
+};
+
+// An `o`, `g` or `usemtl` line, recorded at the face corner from which it applies.
+struct ObjGroupEvent
+{
+    bool isMaterial = false;
+    std::string value = {};
+    size_t firstCorner = 0;
+};
+
+enum ObjLineType
+{
+    OBJ_LINE_OTHER,
+    OBJ_LINE_POSITION,
+    OBJ_LINE_TEXCOORD,
+    OBJ_LINE_NORMAL,
+    OBJ_LINE_FACE,
+    OBJ_LINE_GROUP,
+    OBJ_LINE_MATERIAL,
+};
+
+// Identifies a line by its keyword and moves `cursor` past the keyword.
+inline ObjLineType classifyLine(const char *&cursor)
+{
+    cursor = skipBlanks(cursor);
+
+    switch (cursor[0])
+    {
+    case 'v':
+        if (isBlank(cursor[1]))
+        {
+            cursor += 2;
+            return OBJ_LINE_POSITION;
+        }
+        if (cursor[1] == 't' && isBlank(cursor[2]))
+        {
+            cursor += 3;
+            return OBJ_LINE_TEXCOORD;
+        }
+        if (cursor[1] == 'n' && isBlank(cursor[2]))
+        {
+            cursor += 3;
+            return OBJ_LINE_NORMAL;
+        }
+        break;
+    case 'f':
+        if (isBlank(cursor[1]))
+        {
+            cursor += 2;
+            return OBJ_LINE_FACE;
+        }
+        break;
+    case 'o':
+    case 'g':
+        // A bare `g` switches back to the default group.
+        if (isBlank(cursor[1]) || cursor[1] == '\n' || cursor[1] == '\0')
+        {
+            cursor += 1;
+            return OBJ_LINE_GROUP;
+        }
+        break;
+    case 'u':
+        if (strncmp(cursor, "usemtl", 6) == 0 && isBlank(cursor[6]))
+        {
+            cursor += 7;
+            return OBJ_LINE_MATERIAL;
+        }
+        break;
+    }
+
+    return OBJ_LINE_OTHER;
+}
+
+inline bool isTupleEnd(char c)
+{
+    return isBlank(c) || c == '\n' || c == '\0';
+}
+
+inline bool isFaceEnd(char c)
+{
+    return c == '\n' || c == '\0' || c == '#';
+}
+
+// Counts the tuples on a face line, noting whether any of them carries `/vt` or `/vn` parts.
+inline unsigned countTuples(const char *cursor, bool &hasSlash)
+{
+    unsigned numTuples = 0;
+
+    for (cursor = skipBlanks(cursor); isFaceEnd(*cursor) == false; cursor = skipBlanks(cursor))
+    {
+        numTuples++;
+
+        for (; isTupleEnd(*cursor) == false; cursor++)
+            hasSlash |= *cursor == '/';
+    }
+
+    return numTuples;
+}
+
+// Parses a `v`, `v/vt`, `v//vn` or `v/vt/vn` tuple into zero-based indices. Parts that are absent or malformed are left as OBJ_MISSING_INDEX.
+inline const char *parseTuple(const char *cursor, const uint32_t counts[3], uint32_t tuple[3])
+{
+    tuple[0] = tuple[1] = tuple[2] = OBJ_MISSING_INDEX;
+
+    for (int part = 0; part < 3; part++)
+    {
+        cursor = parseIndex(cursor, counts[part], tuple[part]);
+
+        if (*cursor != '/')
+            break;
+
+        cursor++;
+    }
+
+    // Skip anything malformed so the next tuple starts cleanly.
+    while (isTupleEnd(*cursor) == false)
+        cursor++;
+
+    return cursor;
+}
+
+// Returns the rest of the line, without surrounding blanks, as used for group and material names.
+inline std::string readName(const char *cursor)
+{
+    cursor = skipBlanks(cursor);
+
+    const char *end = cursor;
+
+    while (*end != '\n' && *end != '\0')
+        end++;
+
+    while (end > cursor && isBlank(end[-1]))
+        end--;
+
+    return std::string(cursor, end);
+}
+
+// A newline-aligned slice of a read window that one thread counts and then parses.
+struct ObjChunk
+{
+    const char *begin = nullptr;
+    const char *end = nullptr;
+    unsigned numPositions = 0;
+    unsigned numTexcoords = 0;
+    unsigned numNormals = 0;
+    // Faces are fan-triangulated, so an n-gon contributes 3 * (n - 2) corners.
+    size_t numCorners = 0;
+    bool hasSlash = false;
+    // Elements in the file before this chunk, which negative indices resolve against.
+    uint32_t bases[3] = {};
+    float *positionOutput = nullptr;
+    float *texcoordOutput = nullptr;
+    float *normalOutput = nullptr;
+    // Position, texcoord and normal index of every corner. The last two are null when no face in the window uses them.
+    uint32_t *cornerOutputs[3] = {};
+    // OBJ_ATTRIBUTE_* bits that at least one corner refers to.
+    uint32_t attributes = 0;
+    std::vector<ObjGroupEvent> groupEvents = {};
+};
+
+// The raw output of one read window, or of the whole file once gathered. Kept as separate allocations so nothing is reallocated while the file streams in.
+struct ObjBlock
+{
+    float *positions = nullptr;
+    float *texcoords = nullptr;
+    float *normals = nullptr;
+    uint32_t *corners[3] = {};
+    size_t numPositions = 0;
+    size_t numTexcoords = 0;
+    size_t numNormals = 0;
+    size_t numCorners = 0;
+};
+
+// Runs `function` on every chunk, one thread per chunk, using the calling thread for the first.
+template <typename Function>
+void forEachChunk(std::vector<ObjChunk> &chunks, Function function)
+{
+    runOnThreads((unsigned)chunks.size(), [&](unsigned chunkIndex)
+                 { function(chunks[chunkIndex]); });
+}
+
+struct Obj
+{
+    // Interleaved position, then normal and texcoord if present; see `vertexAttributes`. Once quantized, the vertices are packed
+    // 16-bit values instead of floats and, for VK_INDEX_TYPE_UINT16, the indices are 16-bit. The indices hold every LOD; see `lods`.
+    alignas(16) float *vertexData = nullptr;
+    alignas(16) unsigned *indexData = nullptr;
+    size_t vertexDataSize = 0;
+    size_t indexDataSize = 0;
+    unsigned numVertices = 0;
+    unsigned numIndices = 0;
+    uint32_t vertexAttributes = 0;
+    bool quantized = false;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+    // Of the positions as loaded, before any quantization.
+    float boundsMin[3] = {};
+    float boundsMax[3] = {};
+    // Center and radius, enclosing every position.
+    float boundingSphere[4] = {};
+    std::vector<ObjGroup> groups = {};
+    // Meshlets cover the index buffer in order and never cross a group.
+    Meshlet *meshletData = nullptr;
+    size_t meshletDataSize = 0;
+    unsigned numMeshlets = 0;
+    // LOD 0 is the mesh as loaded; every further LOD has fewer triangles and a larger error.
+    std::vector<ObjLod> lods = {};
+    ObjLoadTimings timings = {};
+
+    // Set when the data points into a mapped `.meshcache` file instead of owned allocations.
+    void *cacheView = nullptr;
+
+    ~Obj()
+    {
+        if (cacheView != nullptr)
+        {
+            UnmapViewOfFile(cacheView);
+            return;
+        }
+
+        if (vertexData != nullptr)
+            free(vertexData);
+        if (indexData != nullptr)
+            free(indexData);
+        if (meshletData != nullptr)
+            free(meshletData);
+    }
+
+    // Streams the file through a fixed-size window, so memory use follows the size of the mesh rather than of its text.
+    // Unless disabled, a valid `<filename>.meshcache` is mapped instead of parsing, and one is written after every parse.
+    Obj(const char *filename, const ObjLoadInfo &loadInfo = {})
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        std::string cachePath = std::string(filename) + ".meshcache";
+        MeshCacheHeader cacheKey = {};
+        bool hasCacheKey = loadInfo.useCache && getMeshCacheKey(filename, cacheKey);
+
+        cacheKey.optimized = loadInfo.optimizeMesh;
+        cacheKey.quantized = loadInfo.quantizeVertices;
+        cacheKey.maxLods = std::max(loadInfo.maxLods, 1u);
+
+        if (hasCacheKey && loadCache(cachePath.c_str(), cacheKey))
+        {
+            timings.cache = timings.total = getSecondsSince(start);
+
+            float elapsed = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+            printf("Loaded %s from cache: %u vertices, %u triangles, %zu LODs, %.2f ms\n", filename, numVertices, lods[0].numIndices / 3, lods.size(), elapsed);
+            printLods();
+            return;
+        }
+
+        FILE *file = fopen(filename, "rb");
+
+        if (file == NULL)
+        {
+            printf("Failed to open %s\n", filename);
+            return;
+        }
+
+        // Reads land directly in the window, so the CRT's own buffer would only add a copy.
+        setvbuf(file, NULL, _IONBF, 0);
+
+        _fseeki64(file, 0, SEEK_END);
+        uint64_t size = _ftelli64(file);
+        _fseeki64(file, 0, SEEK_SET);
+
+        size_t windowSize = std::max<size_t>(loadInfo.windowSize, OBJ_PARSE_PADDING);
+        char *window = (char *)malloc(windowSize + OBJ_PARSE_PADDING);
+
+        std::vector<ObjBlock> blocks = {};
+        std::vector<ObjGroupEvent> groupEvents = {};
+        ObjBlock totals = {};
+        uint64_t bytesRead = 0;
+        size_t carried = 0;
+
+        while (true)
+        {
+            // A single line fills the whole window, so make room for the rest of it.
+            if (carried == windowSize)
+            {
+                windowSize *= 2;
+                window = (char *)realloc(window, windowSize + OBJ_PARSE_PADDING);
+            }
+
+            auto readStart = std::chrono::high_resolution_clock::now();
+            size_t numRead = fread(window + carried, 1, windowSize - carried, file);
+            timings.read += getSecondsSince(readStart);
+            size_t filled = carried + numRead;
+            bool lastWindow = numRead < windowSize - carried;
+
+            bytesRead += numRead;
+
+            memset(window + filled, 0, OBJ_PARSE_PADDING);
+
+            // Only whole lines are parsed; a trailing partial line is carried into the next window.
+            size_t parsed = filled;
+
+            if (lastWindow == false)
+                while (parsed > 0 && window[parsed - 1] != '\n')
+                    parsed--;
+
+            if (parsed > 0)
+            {
+                ObjBlock block = parseWindow(window, window + parsed, totals, groupEvents, loadInfo.numThreads);
+
+                totals.numPositions += block.numPositions;
+                totals.numTexcoords += block.numTexcoords;
+                totals.numNormals += block.numNormals;
+                totals.numCorners += block.numCorners;
+                blocks.push_back(block);
+            }
+
+            // Indices are 32-bit, so anything past that would be truncated into a corrupt index buffer.
+            if (std::max({totals.numPositions, totals.numTexcoords, totals.numNormals, totals.numCorners}) > UINT32_MAX)
+                break;
+
+            if (loadInfo.pfnProgress != nullptr)
+                loadInfo.pfnProgress(bytesRead, size, loadInfo.pUserData);
+
+            carried = filled - parsed;
+            memmove(window, window + parsed, carried);
+
+            if (lastWindow)
+                break;
+        }
+
+        // A short read ends the loop the same way the end of the file does, so only this tells the two apart.
+        bool readFailed = ferror(file) != 0;
+
+        fclose(file);
+        free(window);
+
+        if (std::max({totals.numPositions, totals.numTexcoords, totals.numNormals, totals.numCorners}) > UINT32_MAX)
+        {
+            printf("Too many elements to index in %s: %zu positions, %zu texcoords, %zu normals, %zu corners\n", filename, totals.numPositions,
+                   totals.numTexcoords, totals.numNormals, totals.numCorners);
+
+            for (auto &block : blocks)
+                freeBlock(block);
+
+            return;
+        }
+
+        // A truncated mesh would otherwise be cached under the source's size and time, and loaded from there from then on.
+        if (readFailed || bytesRead != size)
+        {
+            printf("Failed to read %s: got %llu of %llu bytes\n", filename, (unsigned long long)bytesRead, (unsigned long long)size);
+
+            for (auto &block : blocks)
+                freeBlock(block);
+
+            return;
+        }
+
+        // Gathering the windows counts towards building the vertices, although the normals need it first.
+        auto stageStart = std::chrono::high_resolution_clock::now();
+        ObjBlock mesh = gatherBlocks(blocks, totals);
+
+        double gather = getSecondsSince(stageStart);
+        stageStart = std::chrono::high_resolution_clock::now();
+
+        buildNormalsAndBounds(mesh, loadInfo.numThreads);
+
+        timings.normals = getSecondsSince(stageStart);
+        stageStart = std::chrono::high_resolution_clock::now();
+
+        numIndices = (unsigned)mesh.numCorners;
+
+        buildVertices(mesh, loadInfo.numThreads);
+
+        buildGroups(groupEvents);
+
+        timings.build = gather + getSecondsSince(stageStart);
+        stageStart = std::chrono::high_resolution_clock::now();
+
+        buildLods(filename, loadInfo.maxLods);
+
+        timings.simplify = getSecondsSince(stageStart);
+        stageStart = std::chrono::high_resolution_clock::now();
+
+        if (loadInfo.optimizeMesh)
+            optimize(filename);
+
+        timings.optimize = getSecondsSince(stageStart);
+        stageStart = std::chrono::high_resolution_clock::now();
+
+        buildGroupMeshlets();
+
+        timings.meshlets = getSecondsSince(stageStart);
+        stageStart = std::chrono::high_resolution_clock::now();
+
+        if (loadInfo.quantizeVertices)
+            quantize();
+
+        vertexDataSize = (size_t)numVertices * getVertexStride();
+        indexDataSize = (indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t)) * numIndices;
+
+        timings.quantize = getSecondsSince(stageStart);
+        stageStart = std::chrono::high_resolution_clock::now();
+
+        if (hasCacheKey)
+            writeCache(cachePath.c_str(), cacheKey);
+
+        timings.cache = getSecondsSince(stageStart);
+        timings.total = getSecondsSince(start);
+
+        float elapsed = std::chrono::duration<float, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+        printf("Loaded %s: %u vertices, %u triangles, %zu groups, %zu LODs, %u meshlets, %zu windows, %.1f MB/s\n", filename, numVertices, lods[0].numIndices / 3, groups.size(), lods.size(), numMeshlets, blocks.size(), size / elapsed / 1e6f);
+        printLods();
+    }
+
+    void printLods()
+    {
+        for (size_t lod = 0; lod < lods.size(); lod++)
+            printf("  LOD %zu: %u triangles, %u meshlets, error %g\n", lod, lods[lod].numIndices / 3, lods[lod].numMeshlets, lods[lod].error);
+    }
+
+    uint32_t getVertexStride()
+    {
+        if (quantized)
+        {
+            // The position is padded to four components, as three-component 16-bit formats are rarely supported for vertex input.
+            uint32_t stride = sizeof(uint16_t) * 4;
+
+            if (vertexAttributes & OBJ_ATTRIBUTE_NORMAL_BIT)
+                stride += sizeof(int16_t) * 2;
+            if (vertexAttributes & OBJ_ATTRIBUTE_TEXCOORD_BIT)
+                stride += sizeof(uint16_t) * 2;
+
+            return stride;
+        }
+
+        uint32_t numFloats = 3;
+
+        if (vertexAttributes & OBJ_ATTRIBUTE_NORMAL_BIT)
+            numFloats += 3;
+        if (vertexAttributes & OBJ_ATTRIBUTE_TEXCOORD_BIT)
+            numFloats += 2;
+
+        return sizeof(float) * numFloats;
+    }
+
+    // The shader reconstructs positions as `pos * scale + offset`, which is the identity for float positions.
+    void getPositionDecode(float scale[3], float offset[3])
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            scale[i] = quantized ? boundsMax[i] - boundsMin[i] : 1.0f;
+            offset[i] = quantized ? boundsMin[i] : 0.0f;
+        }
+    }
+
+    // Counts and parses the whole lines in [begin, end) into a new block, splitting the work across up to `numThreads` threads.
+    // `preceding` holds the element counts of every earlier window.
+    ObjBlock parseWindow(const char *begin, const char *end, const ObjBlock &preceding, std::vector<ObjGroupEvent> &groupEvents, unsigned numThreads)
+    {
+        size_t size = end - begin;
+
+        // Split at newlines so that no line straddles two chunks.
+
+        size_t numChunks = std::clamp<size_t>(size / OBJ_MIN_CHUNK_SIZE, 1, std::max(numThreads, 1u));
+        std::vector<ObjChunk> chunks = {};
+        chunks.reserve(numChunks);
+
+        const char *chunkBegin = begin;
+
+        for (size_t i = 1; i <= numChunks && chunkBegin < end; i++)
+        {
+            const char *chunkEnd = i == numChunks ? end : nextLine(std::max<const char *>(chunkBegin, begin + size * i / numChunks), end);
+
+            chunks.push_back({.begin = chunkBegin, .end = chunkEnd});
+            chunkBegin = chunkEnd;
+        }
+
+        auto countStart = std::chrono::high_resolution_clock::now();
+        forEachChunk(chunks, countChunk);
+        timings.count += getSecondsSince(countStart);
+
+        ObjBlock block = {};
+        bool hasSlash = false;
+
+        for (const auto &chunk : chunks)
+        {
+            block.numPositions += chunk.numPositions;
+            block.numTexcoords += chunk.numTexcoords;
+            block.numNormals += chunk.numNormals;
+            block.numCorners += chunk.numCorners;
+            hasSlash |= chunk.hasSlash;
+        }
+
+        block.positions = (float *)malloc(sizeof(float) * block.numPositions * 3);
+        block.texcoords = (float *)malloc(sizeof(float) * block.numTexcoords * 2);
+        block.normals = (float *)malloc(sizeof(float) * block.numNormals * 3);
+        block.corners[0] = (uint32_t *)malloc(sizeof(uint32_t) * block.numCorners);
+
+        if (hasSlash)
+        {
+            block.corners[1] = (uint32_t *)malloc(sizeof(uint32_t) * block.numCorners);
+            block.corners[2] = (uint32_t *)malloc(sizeof(uint32_t) * block.numCorners);
+        }
+
+        ObjBlock offsets = preceding;
+        size_t cornerOffset = 0;
+
+        for (auto &chunk : chunks)
+        {
+            chunk.bases[0] = (uint32_t)offsets.numPositions;
+            chunk.bases[1] = (uint32_t)offsets.numTexcoords;
+            chunk.bases[2] = (uint32_t)offsets.numNormals;
+            chunk.positionOutput = block.positions + (offsets.numPositions - preceding.numPositions) * 3;
+            chunk.texcoordOutput = block.texcoords + (offsets.numTexcoords - preceding.numTexcoords) * 2;
+            chunk.normalOutput = block.normals + (offsets.numNormals - preceding.numNormals) * 3;
+
+            for (int part = 0; part < 3; part++)
+                if (block.corners[part] != nullptr)
+                    chunk.cornerOutputs[part] = block.corners[part] + cornerOffset;
+
+            offsets.numPositions += chunk.numPositions;
+            offsets.numTexcoords += chunk.numTexcoords;
+            offsets.numNormals += chunk.numNormals;
+            cornerOffset += chunk.numCorners;
+        }
+
+        auto parseStart = std::chrono::high_resolution_clock::now();
+        forEachChunk(chunks, parseChunk);
+        timings.parse += getSecondsSince(parseStart);
+
+        cornerOffset = preceding.numCorners;
+
+        for (auto &chunk : chunks)
+        {
+            vertexAttributes |= chunk.attributes;
+
+            for (auto &event : chunk.groupEvents)
+            {
+                event.firstCorner += cornerOffset;
+                groupEvents.push_back(std::move(event));
+            }
+
+            cornerOffset += chunk.numCorners;
+        }
+
+        return block;
+    }
+
+    static void countChunk(ObjChunk &chunk)
+    {
+        for (const char *line = chunk.begin; line < chunk.end; line = nextLine(line, chunk.end))
+        {
+            const char *cursor = line;
+
+            switch (classifyLine(cursor))
+            {
+            case OBJ_LINE_POSITION:
+                chunk.numPositions++;
+                break;
+            case OBJ_LINE_TEXCOORD:
+                chunk.numTexcoords++;
+                break;
+            case OBJ_LINE_NORMAL:
+                chunk.numNormals++;
+                break;
+            case OBJ_LINE_FACE:
+            {
+                unsigned numTuples = countTuples(cursor, chunk.hasSlash);
+
+                if (numTuples >= 3)
+                    chunk.numCorners += (numTuples - 2) * 3;
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    static void parseChunk(ObjChunk &chunk)
+    {
+        // Elements seen so far, for resolving negative indices.
+        uint32_t counts[3] = {chunk.bases[0], chunk.bases[1], chunk.bases[2]};
+        float *position = chunk.positionOutput;
+        float *texcoord = chunk.texcoordOutput;
+        float *normal = chunk.normalOutput;
+        size_t corner = 0;
+
+        for (const char *line = chunk.begin; line < chunk.end;)
+        {
+            const char *cursor = line;
+
+            switch (classifyLine(cursor))
+            {
+            case OBJ_LINE_POSITION:
+                // Any `w` or vertex colour after the first three values is ignored. Missing values are 0.
+                position[0] = 0.0f;
+                position[1] = 0.0f;
+                position[2] = 0.0f;
+
+                for (int i = 0; i < 3; i++)
+                    cursor = parseFloat(skipBlanks(cursor), position[i]);
+
+                // printf("v %f %f %f\n", position[0], position[1], position[2]);
+
+                position += 3;
+                counts[0]++;
+                break;
+            case OBJ_LINE_TEXCOORD:
+                // `v` is optional and defaults to 0; `w` is ignored.
+                texcoord[0] = 0.0f;
+                texcoord[1] = 0.0f;
+
+                for (int i = 0; i < 2; i++)
+                    cursor = parseFloat(skipBlanks(cursor), texcoord[i]);
+
+                texcoord += 2;
+                counts[1]++;
+                break;
+            case OBJ_LINE_NORMAL:
+                normal[0] = 0.0f;
+                normal[1] = 0.0f;
+                normal[2] = 0.0f;
+
+                for (int i = 0; i < 3; i++)
+                    cursor = parseFloat(skipBlanks(cursor), normal[i]);
+
+                normal += 3;
+                counts[2]++;
+                break;
+            case OBJ_LINE_FACE:
+            {
+                uint32_t tuples[3][3] = {};
+                unsigned numTuples = 0;
+
+                // Fan-triangulate: every tuple after the second closes a triangle with the first and the previous one.
+                for (cursor = skipBlanks(cursor); isFaceEnd(*cursor) == false; cursor = skipBlanks(cursor))
+                {
+                    uint32_t *tuple = tuples[std::min(numTuples, 2u)];
+
+                    if (numTuples > 2)
+                        memcpy(tuples[1], tuples[2], sizeof(tuples[2]));
+
+                    // Negative indices resolve against every element before this line, including those in earlier chunks and windows.
+                    cursor = parseTuple(cursor, counts, tuple);
+                    numTuples++;
+
+                    if (numTuples < 3)
+                        continue;
+
+                    for (const auto &cornerTuple : tuples)
+                    {
+                        for (int part = 0; part < 3; part++)
+                            if (chunk.cornerOutputs[part] != nullptr)
+                                chunk.cornerOutputs[part][corner] = cornerTuple[part];
+
+                        if (cornerTuple[1] != OBJ_MISSING_INDEX)
+                            chunk.attributes |= OBJ_ATTRIBUTE_TEXCOORD_BIT;
+                        if (cornerTuple[2] != OBJ_MISSING_INDEX)
+                            chunk.attributes |= OBJ_ATTRIBUTE_NORMAL_BIT;
+
+                        corner++;
+                    }
+                }
+
+                // printf("f %u %u %u\n", tuples[0][0], tuples[1][0], tuples[2][0]);
+                break;
+            }
+            case OBJ_LINE_GROUP:
+                chunk.groupEvents.push_back({.isMaterial = false, .value = readName(cursor), .firstCorner = corner});
+                break;
+            case OBJ_LINE_MATERIAL:
+                chunk.groupEvents.push_back({.isMaterial = true, .value = readName(cursor), .firstCorner = corner});
+                break;
+            default:
+                break;
+            }
+
+            line = nextLine(cursor, chunk.end);
+        }
+    }
+
+    // Concatenates the blocks into one, freeing each as soon as it is copied so peak memory stays close to the size of the output.
+    // A single block is adopted without copying.
+    static ObjBlock gatherBlocks(std::vector<ObjBlock> &blocks, const ObjBlock &totals)
+    {
+        if (blocks.size() == 1)
+            return blocks[0];
+
+        ObjBlock mesh = totals;
+
+        mesh.positions = (float *)malloc(sizeof(float) * totals.numPositions * 3);
+        mesh.texcoords = (float *)malloc(sizeof(float) * totals.numTexcoords * 2);
+        mesh.normals = (float *)malloc(sizeof(float) * totals.numNormals * 3);
+
+        bool hasSlash = false;
+
+        for (const auto &block : blocks)
+            hasSlash |= block.corners[1] != nullptr;
+
+        for (int part = 0; part < (hasSlash ? 3 : 1); part++)
+            mesh.corners[part] = (uint32_t *)malloc(sizeof(uint32_t) * totals.numCorners);
+
+        ObjBlock offsets = {};
+
+        for (auto &block : blocks)
+        {
+            memcpy(mesh.positions + offsets.numPositions * 3, block.positions, sizeof(float) * block.numPositions * 3);
+            memcpy(mesh.texcoords + offsets.numTexcoords * 2, block.texcoords, sizeof(float) * block.numTexcoords * 2);
+            memcpy(mesh.normals + offsets.numNormals * 3, block.normals, sizeof(float) * block.numNormals * 3);
+
+            for (int part = 0; part < 3; part++)
+            {
+                if (mesh.corners[part] == nullptr)
+                    continue;
+
+                if (block.corners[part] != nullptr)
+                    memcpy(mesh.corners[part] + offsets.numCorners, block.corners[part], sizeof(uint32_t) * block.numCorners);
+                else
+                    std::fill_n(mesh.corners[part] + offsets.numCorners, block.numCorners, OBJ_MISSING_INDEX);
+            }
+
+            offsets.numPositions += block.numPositions;
+            offsets.numTexcoords += block.numTexcoords;
+            offsets.numNormals += block.numNormals;
+            offsets.numCorners += block.numCorners;
+
+            freeBlock(block);
+        }
+
+        return mesh;
+    }
+
+    static void freeBlock(ObjBlock &block)
+    {
+        free(block.positions);
+        free(block.texcoords);
+        free(block.normals);
+
+        for (auto &corners : block.corners)
+            free(corners);
+
+        block = {};
+    }
+
+    // Computes the bounds and, when the file has no normals, replaces them with smooth normals indexed like the positions, so that
+    // vertices split only by texcoord seams still share a normal. Must run before `buildVertices`.
+    void buildNormalsAndBounds(ObjBlock &mesh, unsigned numThreads)
+    {
+        bool generateNormals = (vertexAttributes & OBJ_ATTRIBUTE_NORMAL_BIT) == 0 && mesh.numCorners > 0;
+
+        if (generateNormals)
+        {
+            free(mesh.normals);
+            mesh.normals = (float *)malloc(sizeof(float) * mesh.numPositions * 3);
+            mesh.numNormals = mesh.numPositions;
+        }
+
+        computeNormalsAndBounds(mesh.positions, mesh.numPositions, mesh.corners[0], generateNormals ? mesh.numCorners : 0, numThreads, generateNormals ? mesh.normals : nullptr, boundsMin, boundsMax, boundingSphere);
+
+        if (generateNormals == false)
+            return;
+
+        if (mesh.corners[1] == nullptr)
+        {
+            mesh.corners[1] = (uint32_t *)malloc(sizeof(uint32_t) * mesh.numCorners);
+            std::fill_n(mesh.corners[1], mesh.numCorners, OBJ_MISSING_INDEX);
+        }
+
+        free(mesh.corners[2]);
+        mesh.corners[2] = (uint32_t *)malloc(sizeof(uint32_t) * mesh.numCorners);
+        memcpy(mesh.corners[2], mesh.corners[0], sizeof(uint32_t) * mesh.numCorners);
+
+        vertexAttributes |= OBJ_ATTRIBUTE_NORMAL_BIT;
+    }
+
+    // Turns the gathered attributes and corners into the final vertex and index streams, consuming `mesh`.
+    void buildVertices(ObjBlock &mesh, unsigned numThreads)
+    {
+        // Positions only: the file's own vertices and indices are used as-is.
+        if (vertexAttributes == 0)
+        {
+            size_t numInvalid = 0;
+
+            for (size_t i = 0; i < mesh.numCorners; i++)
+            {
+                if (mesh.corners[0][i] >= mesh.numPositions)
+                {
+                    mesh.corners[0][i] = 0;
+                    numInvalid++;
+                }
+            }
+
+            if (numInvalid > 0)
+                printf("Replaced %zu out-of-range face indices\n", numInvalid);
+
+            vertexData = mesh.positions;
+            indexData = mesh.corners[0];
+            numVertices = (unsigned)mesh.numPositions;
+
+            mesh.positions = nullptr;
+            mesh.corners[0] = nullptr;
+            freeBlock(mesh);
+            return;
+        }
+
+        // Out-of-range references become missing so that they all share one vertex.
+
+        const size_t counts[3] = {mesh.numPositions, mesh.numTexcoords, mesh.numNormals};
+
+        parallelFor(getUsefulThreadCount(numThreads, mesh.numCorners, OBJ_DEDUP_MIN_CORNERS_PER_THREAD), mesh.numCorners, [&](size_t begin, size_t end)
+                    {
+                        for (int part = 0; part < 3; part++)
+                            for (size_t i = begin; i < end; i++)
+                                if (mesh.corners[part][i] >= counts[part])
+                                    mesh.corners[part][i] = OBJ_MISSING_INDEX; });
+
+        std::vector<uint32_t> firstCorners = {};
+        indexData = (unsigned *)malloc(sizeof(unsigned) * mesh.numCorners);
+
+        deduplicateCorners(mesh.corners[0], mesh.corners[1], mesh.corners[2], mesh.numCorners, numThreads, indexData, firstCorners);
+
+        numVertices = (unsigned)firstCorners.size();
+
+        uint32_t stride = getVertexStride() / sizeof(float);
+        vertexData = (float *)malloc(sizeof(float) * stride * numVertices);
+
+        parallelFor(getUsefulThreadCount(numThreads, numVertices, OBJ_MIN_VERTICES_PER_THREAD), numVertices, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; i++)
+                        {
+                            uint32_t corner = firstCorners[i];
+                            float *vertex = vertexData + i * stride;
+                            uint32_t position = mesh.corners[0][corner];
+
+                            for (int j = 0; j < 3; j++)
+                                vertex[j] = position != OBJ_MISSING_INDEX ? mesh.positions[position * 3 + j] : 0.0f;
+
+                            vertex += 3;
+
+                            if (vertexAttributes & OBJ_ATTRIBUTE_NORMAL_BIT)
+                            {
+                                uint32_t normal = mesh.corners[2][corner];
+
+                                for (int j = 0; j < 3; j++)
+                                    vertex[j] = normal != OBJ_MISSING_INDEX ? mesh.normals[normal * 3 + j] : 0.0f;
+
+                                vertex += 3;
+                            }
+
+                            if (vertexAttributes & OBJ_ATTRIBUTE_TEXCOORD_BIT)
+                            {
+                                uint32_t texcoord = mesh.corners[1][corner];
+
+                                for (int j = 0; j < 2; j++)
+                                    vertex[j] = texcoord != OBJ_MISSING_INDEX ? mesh.texcoords[texcoord * 2 + j] : 0.0f;
+                            }
+                        } });
+
+        freeBlock(mesh);
+    }
+
+    // Runs the mesh optimizer on every group separately, so group ranges stay intact, then reorders the shared vertex stream.
+    void optimize(const char *filename)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        VertexCacheStats before = analyzeVertexCache(indexData, numIndices, numVertices);
+
+        // Each group is optimized on compact local vertex ids so the per-vertex scratch stays proportional to the group.
+
+        std::vector<uint32_t> localIds(numVertices, OBJ_MISSING_INDEX);
+        std::vector<uint32_t> globalIds = {};
+        std::vector<unsigned> localIndices = {};
+        std::vector<float> localPositions = {};
+        std::vector<size_t> hardBoundaries = {};
+        uint32_t stride = getVertexStride() / sizeof(float);
+
+        auto optimizeRange = [&](unsigned firstIndex, unsigned rangeSize)
+        {
+            globalIds.clear();
+            localIndices.resize(rangeSize);
+
+            for (unsigned i = 0; i < rangeSize; i++)
+            {
+                uint32_t &localId = localIds[indexData[firstIndex + i]];
+
+                if (localId == OBJ_MISSING_INDEX)
+                {
+                    localId = (uint32_t)globalIds.size();
+                    globalIds.push_back(indexData[firstIndex + i]);
+                }
+
+                localIndices[i] = localId;
+            }
+
+            localPositions.resize(globalIds.size() * 3);
+
+            for (size_t i = 0; i < globalIds.size(); i++)
+                memcpy(&localPositions[i * 3], vertexData + (size_t)globalIds[i] * stride, sizeof(float) * 3);
+
+            optimizeVertexCache(localIndices.data(), rangeSize, (unsigned)globalIds.size(), hardBoundaries);
+            optimizeOverdraw(localIndices.data(), rangeSize, localPositions.data(), (unsigned)globalIds.size(), hardBoundaries, MESH_OVERDRAW_THRESHOLD);
+
+            for (unsigned i = 0; i < rangeSize; i++)
+                indexData[firstIndex + i] = globalIds[localIndices[i]];
+
+            for (uint32_t globalId : globalIds)
+                localIds[globalId] = OBJ_MISSING_INDEX;
+        };
+
+        if (groups.empty())
+            optimizeRange(0, numIndices);
+
+        for (const auto &group : groups)
+            optimizeRange(group.firstIndex, group.numIndices);
+
+        numVertices = optimizeVertexFetch(vertexData, getVertexStride(), numVertices, indexData, numIndices);
+
+        VertexCacheStats after = analyzeVertexCache(indexData, numIndices, numVertices);
+
+        float elapsed = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+        printf("Optimized %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %.1f ms\n", filename, before.acmr, after.acmr, before.atvr, after.atvr, elapsed);
+    }
+
+    // Builds meshlets for every group separately, keeping each LOD's meshlets together. Must run before quantization, as the bounds are
+    // computed from float positions.
+    void buildGroupMeshlets()
+    {
+        std::vector<uint32_t> vertexMeshlets(numVertices, OBJ_MISSING_INDEX);
+        std::vector<Meshlet> meshlets = {};
+        uint32_t stride = getVertexStride() / sizeof(float);
+
+        for (unsigned lod = 0; lod < lods.size(); lod++)
+        {
+            lods[lod].firstMeshlet = (uint32_t)meshlets.size();
+
+            for (const auto &group : groups)
+                if (group.lod == lod)
+                    buildMeshlets(indexData, group.firstIndex, group.numIndices, vertexData, stride, vertexMeshlets, meshlets);
+
+            lods[lod].numMeshlets = (uint32_t)meshlets.size() - lods[lod].firstMeshlet;
+        }
+
+        numMeshlets = (unsigned)meshlets.size();
+        meshletDataSize = sizeof(Meshlet) * numMeshlets;
+        meshletData = (Meshlet *)malloc(meshletDataSize);
+
+        if (numMeshlets > 0)
+            memcpy(meshletData, meshlets.data(), meshletDataSize);
+    }
+
+    // Simplifies LOD 0 into a chain of coarser LODs appended to the index buffer, each with its own group runs. The whole mesh is simplified
+    // at once with group boundaries held in place, so groups never crack apart. Must run before quantization, as the simplifier works on
+    // float positions.
+    void buildLods(const char *filename, unsigned maxLods)
+    {
+        lods = {{.firstIndex = 0, .numIndices = numIndices, .error = 0.0f}};
+
+        if (maxLods <= 1 || numIndices == 0)
+            return;
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        std::vector<uint32_t> triangleGroups(numIndices / 3, 0);
+
+        for (uint32_t group = 0; group < groups.size(); group++)
+            std::fill_n(triangleGroups.begin() + groups[group].firstIndex / 3, groups[group].numIndices / 3, group);
+
+        float extent = 0.0f;
+
+        for (int i = 0; i < 3; i++)
+            extent = std::max(extent, boundsMax[i] - boundsMin[i]);
+
+        MeshSimplifier simplifier(indexData, numIndices, triangleGroups.data(), vertexData, getVertexStride() / sizeof(float), numVertices);
+        std::vector<unsigned> lodIndices = {};
+        std::vector<ObjGroup> lodGroups = {};
+
+        while (lods.size() < maxLods)
+        {
+            size_t previousTriangles = simplifier.getNumTriangles();
+
+            simplifier.simplify((size_t)(previousTriangles * MESH_LOD_REDUCTION), MESH_LOD_MAX_ERROR * extent);
+
+            if (simplifier.getNumTriangles() == 0 || simplifier.getNumTriangles() > previousTriangles * MESH_LOD_MIN_REDUCTION)
+                break;
+
+            unsigned lod = (unsigned)lods.size();
+            unsigned firstIndex = numIndices + (unsigned)lodIndices.size();
+
+            lods.push_back({.firstIndex = firstIndex, .numIndices = (uint32_t)simplifier.indices.size(), .error = simplifier.error});
+
+            for (size_t triangle = 0; triangle < simplifier.getNumTriangles(); triangle++)
+            {
+                uint32_t group = simplifier.triangleGroups[triangle];
+
+                if (triangle == 0 || group != simplifier.triangleGroups[triangle - 1])
+                {
+                    lodGroups.push_back(groups[group]);
+                    lodGroups.back().firstIndex = firstIndex + (unsigned)triangle * 3;
+                    lodGroups.back().numIndices = 0;
+                    lodGroups.back().lod = lod;
+                }
+
+                lodGroups.back().numIndices += 3;
+            }
+
+            lodIndices.insert(lodIndices.end(), simplifier.indices.begin(), simplifier.indices.end());
+        }
+
+        // No coarser LOD was made, e.g. for a single LOD or a tiny mesh, which leaves nothing to append.
+        if (lodIndices.empty() == false)
+        {
+            indexData = (unsigned *)realloc(indexData, sizeof(unsigned) * (numIndices + lodIndices.size()));
+            memcpy(indexData + numIndices, lodIndices.data(), sizeof(unsigned) * lodIndices.size());
+            numIndices += (unsigned)lodIndices.size();
+        }
+
+        groups.insert(groups.end(), lodGroups.begin(), lodGroups.end());
+
+        float elapsed = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+        printf("Simplified %s into %zu LODs, %.1f ms\n", filename, lods.size(), elapsed);
+    }
+
+    // Repacks the float vertices into the quantized layout and narrows the indices in place when they fit in 16 bits.
+    void quantize()
+    {
+        uint32_t floatStride = getVertexStride() / sizeof(float);
+
+        quantized = true;
+
+        uint32_t stride = getVertexStride();
+        char *packed = (char *)malloc((size_t)stride * numVertices);
+        float scale[3] = {};
+        float offset[3] = {};
+
+        getPositionDecode(scale, offset);
+
+        for (unsigned i = 0; i < numVertices; i++)
+        {
+            const float *source = vertexData + (size_t)i * floatStride;
+            char *vertex = packed + (size_t)i * stride;
+
+            uint16_t position[4] = {};
+
+            for (int j = 0; j < 3; j++)
+                position[j] = quantizeUnorm16(source[j], offset[j], scale[j]);
+
+            memcpy(vertex, position, sizeof(position));
+            source += 3;
+            vertex += sizeof(position);
+
+            if (vertexAttributes & OBJ_ATTRIBUTE_NORMAL_BIT)
+            {
+                int16_t normal[2] = {};
+
+                encodeOctahedral(source, normal);
+                memcpy(vertex, normal, sizeof(normal));
+                source += 3;
+                vertex += sizeof(normal);
+            }
+
+            if (vertexAttributes & OBJ_ATTRIBUTE_TEXCOORD_BIT)
+            {
+                uint16_t texcoord[2] = {floatToHalf(source[0]), floatToHalf(source[1])};
+
+                memcpy(vertex, texcoord, sizeof(texcoord));
+            }
+        }
+
+        free(vertexData);
+        vertexData = (float *)packed;
+
+        if (numVertices <= UINT16_MAX)
+        {
+            uint16_t *narrowed = (uint16_t *)indexData;
+
+            // Each 16-bit write lands at or before the 32-bit read of the same index, so this is safe in place.
+            for (unsigned i = 0; i < numIndices; i++)
+                narrowed[i] = (uint16_t)indexData[i];
+
+            indexType = VK_INDEX_TYPE_UINT16;
+        }
+    }
+
+    void buildGroups(const std::vector<ObjGroupEvent> &groupEvents)
+    {
+        ObjGroup current = {};
+
+        // Corners map one-to-one onto indices, so corner offsets are index offsets.
+        for (const auto &event : groupEvents)
+        {
+            if (event.firstCorner > current.firstIndex)
+            {
+                current.numIndices = (unsigned)event.firstCorner - current.firstIndex;
+                groups.push_back(current);
+            }
+
+            current.firstIndex = (unsigned)event.firstCorner;
+
+            if (event.isMaterial)
+                current.material = event.value;
+            else
+                current.name = event.value;
+        }
+
+        if (numIndices > current.firstIndex)
+        {
+            current.numIndices = numIndices - current.firstIndex;
+            groups.push_back(current);
+        }
+    }
+
+    // Maps a cache file copy-on-write and points the mesh data into it. Returns false if the file is missing or does not match `key`.
+    bool loadCache(const char *cachePath, const MeshCacheHeader &key)
+    {
+        HANDLE file = CreateFileA(cachePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize = {};
+        GetFileSizeEx(file, &fileSize);
+
+        HANDLE mapping = NULL;
+
+        if ((uint64_t)fileSize.QuadPart >= sizeof(MeshCacheHeader))
+            mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+
+        // The view keeps the file and the mapping alive.
+        CloseHandle(file);
+
+        if (mapping == NULL)
+            return false;
+
+        void *view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(mapping);
+
+        if (view == NULL)
+            return false;
+
+        const MeshCacheHeader &header = *(const MeshCacheHeader *)view;
+
+        // The layout is derived from the cached attribute bits, then checked against what was stored to catch layout changes in this code.
+        vertexAttributes = header.vertexAttributes;
+        quantized = header.quantized != 0;
+        indexType = header.indexType == VK_INDEX_TYPE_UINT16 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+        auto bindingDescription = getBindingDescription();
+        auto attributeDescriptions = getAttributeDescription();
+
+        bool valid = header.magic == MESH_CACHE_MAGIC &&
+                     header.version == MESH_CACHE_VERSION &&
+                     strcmp(header.sourcePath, key.sourcePath) == 0 &&
+                     header.sourceSize == key.sourceSize &&
+                     header.sourceWriteTime == key.sourceWriteTime &&
+                     header.optimized == key.optimized &&
+                     header.quantized == key.quantized &&
+                     header.maxLods == key.maxLods &&
+                     header.vertexStride == bindingDescription.stride &&
+                     header.numAttributes == attributeDescriptions.size() &&
+                     memcmp(header.attributes, attributeDescriptions.data(), sizeof(VkVertexInputAttributeDescription) * attributeDescriptions.size()) == 0 &&
+                     header.vertexOffset + header.vertexDataSize <= (uint64_t)fileSize.QuadPart &&
+                     header.indexOffset + header.indexDataSize <= (uint64_t)fileSize.QuadPart &&
+                     header.groupOffset + header.groupDataSize <= (uint64_t)fileSize.QuadPart &&
+                     header.meshletOffset + header.meshletDataSize <= (uint64_t)fileSize.QuadPart &&
+                     header.lodOffset + header.lodDataSize <= (uint64_t)fileSize.QuadPart &&
+                     header.meshletDataSize == (uint64_t)header.numMeshlets * sizeof(Meshlet) &&
+                     header.lodDataSize == (uint64_t)header.numLods * sizeof(ObjLod) &&
+                     header.numLods >= 1 &&
+                     header.vertexDataSize == (uint64_t)header.numVertices * header.vertexStride &&
+                     header.indexDataSize == (uint64_t)header.numIndices * (indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t)) &&
+                     header.groupDataSize >= (uint64_t)header.numGroups * sizeof(MeshCacheGroup);
+
+        if (valid)
+        {
+            const MeshCacheGroup *cachedGroups = (const MeshCacheGroup *)((char *)view + header.groupOffset);
+            const char *strings = (const char *)(cachedGroups + header.numGroups);
+            uint64_t stringsSize = header.groupDataSize - sizeof(MeshCacheGroup) * header.numGroups;
+
+            for (uint32_t i = 0; i < header.numGroups && valid; i++)
+            {
+                const MeshCacheGroup &group = cachedGroups[i];
+
+                valid = (uint64_t)group.nameOffset + group.nameLength <= stringsSize &&
+                        (uint64_t)group.materialOffset + group.materialLength <= stringsSize &&
+                        (uint64_t)group.firstIndex + group.numIndices <= header.numIndices &&
+                        group.lod < header.numLods;
+
+                if (valid)
+                    groups.push_back({
+                        .name = std::string(strings + group.nameOffset, group.nameLength),
+                        .material = std::string(strings + group.materialOffset, group.materialLength),
+                        .firstIndex = group.firstIndex,
+                        .numIndices = group.numIndices,
+                        .lod = group.lod,
+                    });
+            }
+
+            const ObjLod *cachedLods = (const ObjLod *)((char *)view + header.lodOffset);
+
+            for (uint32_t i = 0; i < header.numLods && valid; i++)
+            {
+                valid = (uint64_t)cachedLods[i].firstIndex + cachedLods[i].numIndices <= header.numIndices &&
+                        (uint64_t)cachedLods[i].firstMeshlet + cachedLods[i].numMeshlets <= header.numMeshlets;
+
+                if (valid)
+                    lods.push_back(cachedLods[i]);
+            }
+        }
+
+        if (valid == false)
+        {
+            UnmapViewOfFile(view);
+            vertexAttributes = 0;
+            quantized = false;
+            indexType = VK_INDEX_TYPE_UINT32;
+            groups.clear();
+            lods.clear();
+            return false;
+        }
+
+        cacheView = view;
+        vertexData = (float *)((char *)view + header.vertexOffset);
+        indexData = (unsigned *)((char *)view + header.indexOffset);
+        meshletData = (Meshlet *)((char *)view + header.meshletOffset);
+        vertexDataSize = header.vertexDataSize;
+        indexDataSize = header.indexDataSize;
+        numVertices = header.numVertices;
+        numIndices = header.numIndices;
+        meshletDataSize = header.meshletDataSize;
+        numMeshlets = header.numMeshlets;
+        memcpy(boundsMin, header.boundsMin, sizeof(boundsMin));
+        memcpy(boundsMax, header.boundsMax, sizeof(boundsMax));
+        memcpy(boundingSphere, header.boundingSphere, sizeof(boundingSphere));
+
+        return true;
+    }
+
+    // Writes the parsed mesh next to its source. Goes through a temporary file so a crash never leaves a truncated cache behind.
+    void writeCache(const char *cachePath, MeshCacheHeader header)
+    {
+        auto bindingDescription = getBindingDescription();
+        auto attributeDescriptions = getAttributeDescription();
+
+        if (attributeDescriptions.size() > MESH_CACHE_MAX_ATTRIBUTES)
+        {
+            printf("Too many vertex attributes to cache %s\n", cachePath);
+            return;
+        }
+
+        // The group stream is the group records followed by their name and material strings.
+        std::vector<char> groupData(sizeof(MeshCacheGroup) * groups.size());
+        std::vector<MeshCacheGroup> cachedGroups = {};
+
+        for (const auto &group : groups)
+        {
+            size_t stringsSize = groupData.size() - sizeof(MeshCacheGroup) * groups.size();
+
+            cachedGroups.push_back({
+                .nameOffset = (uint32_t)stringsSize,
+                .nameLength = (uint32_t)group.name.size(),
+                .materialOffset = (uint32_t)(stringsSize + group.name.size()),
+                .materialLength = (uint32_t)group.material.size(),
+                .firstIndex = group.firstIndex,
+                .numIndices = group.numIndices,
+                .lod = group.lod,
+            });
+
+            groupData.insert(groupData.end(), group.name.begin(), group.name.end());
+            groupData.insert(groupData.end(), group.material.begin(), group.material.end());
+        }
+
+        if (cachedGroups.empty() == false)
+            memcpy(groupData.data(), cachedGroups.data(), sizeof(MeshCacheGroup) * cachedGroups.size());
+
+        header.vertexDataSize = vertexDataSize;
+        header.indexDataSize = indexDataSize;
+        header.groupDataSize = groupData.size();
+        header.meshletDataSize = meshletDataSize;
+        header.lodDataSize = sizeof(ObjLod) * lods.size();
+        header.numVertices = numVertices;
+        header.numIndices = numIndices;
+        header.numGroups = (uint32_t)groups.size();
+        header.numMeshlets = numMeshlets;
+        header.numLods = (uint32_t)lods.size();
+        memcpy(header.boundsMin, boundsMin, sizeof(boundsMin));
+        memcpy(header.boundsMax, boundsMax, sizeof(boundsMax));
+        memcpy(header.boundingSphere, boundingSphere, sizeof(boundingSphere));
+        header.vertexAttributes = vertexAttributes;
+        header.indexType = indexType;
+        header.vertexStride = bindingDescription.stride;
+        header.numAttributes = (uint32_t)attributeDescriptions.size();
+        memcpy(header.attributes, attributeDescriptions.data(), sizeof(VkVertexInputAttributeDescription) * attributeDescriptions.size());
+
+        struct
+        {
+            const void *data;
+            uint64_t size;
+            uint64_t *offset;
+        } streams[] = {
+            {vertexData, header.vertexDataSize, &header.vertexOffset},
+            {indexData, header.indexDataSize, &header.indexOffset},
+            {groupData.data(), header.groupDataSize, &header.groupOffset},
+            {meshletData, header.meshletDataSize, &header.meshletOffset},
+            {lods.data(), header.lodDataSize, &header.lodOffset},
+        };
+
+        uint64_t offset = sizeof(MeshCacheHeader);
+
+        for (auto &stream : streams)
+        {
+            offset = alignUp(offset, MESH_CACHE_STREAM_ALIGNMENT);
+            *stream.offset = offset;
+            offset += stream.size;
+        }
+
+        std::string temporaryPath = std::string(cachePath) + ".tmp";
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+
+        if (file == NULL)
+        {
+            printf("Failed to create mesh cache %s\n", cachePath);
+            return;
+        }
+
+        const char zeros[MESH_CACHE_STREAM_ALIGNMENT] = {};
+
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+        offset = sizeof(MeshCacheHeader);
+
+        for (const auto &stream : streams)
+        {
+            uint64_t padding = *stream.offset - offset;
+
+            written = written &&
+                      fwrite(zeros, 1, padding, file) == padding &&
+                      fwrite(stream.data, 1, stream.size, file) == stream.size;
+
+            offset = *stream.offset + stream.size;
+        }
+
+        written = fclose(file) == 0 && written;
+
+        if (written == false || MoveFileExA(temporaryPath.c_str(), cachePath, MOVEFILE_REPLACE_EXISTING) == FALSE)
+        {
+            printf("Failed to write mesh cache %s\n", cachePath);
+            DeleteFileA(temporaryPath.c_str());
+        }
+    }
+
+    VkVertexInputBindingDescription getBindingDescription()
+    {
+        VkVertexInputBindingDescription bindingDescription = {
+            .binding = 0,
+            .stride = getVertexStride(),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+        };
+
+        return bindingDescription;
+    }
+
+    // Location 0 is the position, 1 the normal and 2 the texcoord. Absent attributes are left out of both the vertex and the list.
+    // Quantized normals arrive as the two octahedral components and need `decodeOctahedral` in the shader.
+    std::vector<VkVertexInputAttributeDescription> getAttributeDescription()
+    {
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions = {};
+        uint32_t offset = 0;
+
+        attributeDescriptions.push_back({
+            .location = 0,
+            .binding = 0,
+            .format = quantized ? VK_FORMAT_R16G16B16A16_UNORM : VK_FORMAT_R32G32B32_SFLOAT,
+            .offset = offset,
+        });
+        offset += quantized ? sizeof(uint16_t) * 4 : sizeof(float) * 3;
+
+        if (vertexAttributes & OBJ_ATTRIBUTE_NORMAL_BIT)
+        {
+            attributeDescriptions.push_back({
+                .location = 1,
+                .binding = 0,
+                .format = quantized ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R32G32B32_SFLOAT,
+                .offset = offset,
+            });
+            offset += quantized ? sizeof(int16_t) * 2 : sizeof(float) * 3;
+        }
+
+        if (vertexAttributes & OBJ_ATTRIBUTE_TEXCOORD_BIT)
+        {
+            attributeDescriptions.push_back({
+                .location = 2,
+                .binding = 0,
+                .format = quantized ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R32G32_SFLOAT,
+                .offset = offset,
+            });
+        }
+
+        return attributeDescriptions;
+    }
+};
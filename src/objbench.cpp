@@ -0,0 +1,544 @@
+#include <windows.h>
+#include <psapi.h>
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <string>
+#include <charconv>
+#include <chrono>
+
+#include "obj.h"
+
+// Benchmarks the Obj loader end to end on res/bunny.obj and on generated meshes, and prints the results as JSON. Every mesh is loaded in
+// a child process so that its peak working set is its own. Sizes are in millions of triangles and default to 1 and 10; 100 takes several
+// gigabytes of disk per style. `--optimize` includes simplification and optimization in the load.
+//
+//   objbench [--sizes 1,10,100] [--styles fixed,scientific,shortest,attributes] [--data bench-data] [--output results.json] [--optimize]
+//   objbench --run <file> [--optimize]
+
+// MARK: Synthetic meshes
+
+// How the numbers of a generated file are written. The loader's parser has separate paths for these, so each is tracked on its own.
+enum ObjNumberStyle
+{
+    // `0.123457`: six decimals, as most exporters write.
+    OBJ_NUMBER_STYLE_FIXED,
+    // `1.2345679e-01`: as in res/bunny.obj.
+    OBJ_NUMBER_STYLE_SCIENTIFIC,
+    // `0.12345679`: the shortest text that round-trips.
+    OBJ_NUMBER_STYLE_SHORTEST,
+    // Fixed numbers with texcoords and normals, so faces are `v/vt/vn` tuples and vertices need deduplicating.
+    OBJ_NUMBER_STYLE_ATTRIBUTES,
+};
+
+const std::array<const char *, 4> numberStyleNames = {
+    "fixed",
+    "scientific",
+    "shortest",
+    "attributes",
+};
+
+// Output is buffered and written in blocks of this size.
+const size_t GENERATOR_BUFFER_SIZE = 4 << 20;
+
+struct ObjWriter
+{
+    FILE *file = NULL;
+    std::vector<char> buffer = std::vector<char>(GENERATOR_BUFFER_SIZE);
+    size_t used = 0;
+    ObjNumberStyle style = OBJ_NUMBER_STYLE_FIXED;
+
+    void flush()
+    {
+        fwrite(buffer.data(), 1, used, file);
+        used = 0;
+    }
+
+    // Leaves room for the longest line the generator writes.
+    char *reserve()
+    {
+        if (buffer.size() - used < 256)
+            flush();
+
+        return buffer.data() + used;
+    }
+
+    char *writeFloat(char *cursor, float value)
+    {
+        *cursor++ = ' ';
+
+        switch (style)
+        {
+        case OBJ_NUMBER_STYLE_SCIENTIFIC:
+            return std::to_chars(cursor, buffer.data() + buffer.size(), value, std::chars_format::scientific, 7).ptr;
+        case OBJ_NUMBER_STYLE_SHORTEST:
+            return std::to_chars(cursor, buffer.data() + buffer.size(), value).ptr;
+        default:
+            return std::to_chars(cursor, buffer.data() + buffer.size(), value, std::chars_format::fixed, 6).ptr;
+        }
+    }
+
+    char *writeIndex(char *cursor, uint64_t index)
+    {
+        return std::to_chars(cursor, buffer.data() + buffer.size(), index).ptr;
+    }
+};
+
+// Writes a rippled grid with at least `numTriangles` triangles. Vertices come first, then faces, as exporters usually order them.
+inline bool generateObj(const char *path, uint64_t numTriangles, ObjNumberStyle style)
+{
+    ObjWriter writer = {.file = fopen(path, "wb"), .style = style};
+
+    if (writer.file == NULL)
+    {
+        printf("Failed to create %s\n", path);
+        return false;
+    }
+
+    uint64_t columns = (uint64_t)ceil(sqrt(numTriangles / 2.0)) + 1;
+    uint64_t rows = (numTriangles / 2 + columns - 2) / (columns - 1) + 1;
+    bool hasAttributes = style == OBJ_NUMBER_STYLE_ATTRIBUTES;
+
+    for (uint64_t row = 0; row < rows; row++)
+    {
+        for (uint64_t column = 0; column < columns; column++)
+        {
+            float u = (float)column / (columns - 1);
+            float v = (float)row / (rows - 1);
+            float height = 0.05f * sinf(u * 40.0f) * cosf(v * 30.0f);
+
+            char *cursor = writer.reserve();
+
+            *cursor++ = 'v';
+            cursor = writer.writeFloat(cursor, u * 2.0f - 1.0f);
+            cursor = writer.writeFloat(cursor, height);
+            cursor = writer.writeFloat(cursor, v * 2.0f - 1.0f);
+            *cursor++ = '\n';
+
+            if (hasAttributes)
+            {
+                *cursor++ = 'v';
+                *cursor++ = 't';
+                cursor = writer.writeFloat(cursor, u);
+                cursor = writer.writeFloat(cursor, v);
+                *cursor++ = '\n';
+
+                // The analytic normal of the height field.
+                float dx = 0.05f * 40.0f * cosf(u * 40.0f) * cosf(v * 30.0f) * 0.5f;
+                float dz = -0.05f * 30.0f * sinf(u * 40.0f) * sinf(v * 30.0f) * 0.5f;
+                float length = sqrtf(dx * dx + 1.0f + dz * dz);
+
+                *cursor++ = 'v';
+                *cursor++ = 'n';
+                cursor = writer.writeFloat(cursor, -dx / length);
+                cursor = writer.writeFloat(cursor, 1.0f / length);
+                cursor = writer.writeFloat(cursor, -dz / length);
+                *cursor++ = '\n';
+            }
+
+            writer.used = cursor - writer.buffer.data();
+        }
+    }
+
+    for (uint64_t row = 0; row + 1 < rows; row++)
+    {
+        for (uint64_t column = 0; column + 1 < columns; column++)
+        {
+            uint64_t a = row * columns + column + 1;
+            uint64_t quad[2][3] = {{a, a + columns, a + 1}, {a + 1, a + columns, a + columns + 1}};
+
+            char *cursor = writer.reserve();
+
+            for (const auto &triangle : quad)
+            {
+                *cursor++ = 'f';
+
+                for (uint64_t index : triangle)
+                {
+                    *cursor++ = ' ';
+                    cursor = writer.writeIndex(cursor, index);
+
+                    for (int part = 0; hasAttributes && part < 2; part++)
+                    {
+                        *cursor++ = '/';
+                        cursor = writer.writeIndex(cursor, index);
+                    }
+                }
+
+                *cursor++ = '\n';
+            }
+
+            writer.used = cursor - writer.buffer.data();
+        }
+    }
+
+    writer.flush();
+
+    return fclose(writer.file) == 0;
+}
+
+// MARK: Upload
+
+// A minimal headless device, just enough to allocate and fill a host-visible buffer the way the renderer uploads meshes.
+struct UploadDevice
+{
+    VkInstance instance = NULL;
+    VkPhysicalDevice physicalDevice = NULL;
+    VkDevice device = NULL;
+
+    ~UploadDevice()
+    {
+        if (device != NULL)
+            vkDestroyDevice(device, NULL);
+        if (instance != NULL)
+            vkDestroyInstance(instance, NULL);
+    }
+
+    bool initialize()
+    {
+        VkApplicationInfo applicationInfo = {
+            .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+            .pApplicationName = "objbench",
+            .apiVersion = VK_API_VERSION_1_4,
+        };
+
+        VkInstanceCreateInfo instanceInfo = {
+            .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+            .pApplicationInfo = &applicationInfo,
+        };
+
+        if (vkCreateInstance(&instanceInfo, NULL, &instance) != VK_SUCCESS)
+            return false;
+
+        uint32_t numPhysicalDevices = 1;
+
+        if (vkEnumeratePhysicalDevices(instance, &numPhysicalDevices, &physicalDevice) < 0 || numPhysicalDevices == 0)
+            return false;
+
+        float queuePriority = 1.0f;
+
+        VkDeviceQueueCreateInfo queueInfo = {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = 0,
+            .queueCount = 1,
+            .pQueuePriorities = &queuePriority,
+        };
+
+        VkDeviceCreateInfo deviceInfo = {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+            .queueCreateInfoCount = 1,
+            .pQueueCreateInfos = &queueInfo,
+        };
+
+        return vkCreateDevice(physicalDevice, &deviceInfo, NULL, &device) == VK_SUCCESS;
+    }
+
+    // Creates a host-visible buffer, copies the vertices and indices into it and frees it again. Returns the seconds taken, or a negative
+    // value on failure.
+    double upload(const Obj &mesh)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        VkDeviceSize indexOffset = alignUp(mesh.vertexDataSize, 16);
+
+        VkBufferCreateInfo bufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = std::max<VkDeviceSize>(indexOffset + mesh.indexDataSize, 1),
+            .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+
+        VkBuffer buffer = NULL;
+
+        if (vkCreateBuffer(device, &bufferInfo, NULL, &buffer) != VK_SUCCESS)
+            return -1.0;
+
+        VkMemoryRequirements memoryRequirements = {};
+        vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+
+        VkPhysicalDeviceMemoryProperties memoryProperties = {};
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        uint32_t memoryTypeIndex = UINT32_MAX;
+
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+        {
+            if ((memoryRequirements.memoryTypeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+            {
+                memoryTypeIndex = i;
+                break;
+            }
+        }
+
+        VkMemoryAllocateInfo allocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = memoryRequirements.size,
+            .memoryTypeIndex = memoryTypeIndex,
+        };
+
+        VkDeviceMemory memory = NULL;
+        void *mapped = nullptr;
+
+        bool uploaded = memoryTypeIndex != UINT32_MAX &&
+                        vkAllocateMemory(device, &allocateInfo, NULL, &memory) == VK_SUCCESS &&
+                        vkBindBufferMemory(device, buffer, memory, 0) == VK_SUCCESS &&
+                        vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) == VK_SUCCESS;
+
+        if (uploaded)
+        {
+            memcpy(mapped, mesh.vertexData, mesh.vertexDataSize);
+            memcpy((char *)mapped + indexOffset, mesh.indexData, mesh.indexDataSize);
+            vkUnmapMemory(device, memory);
+        }
+
+        double elapsed = getSecondsSince(start);
+
+        vkDestroyBuffer(device, buffer, NULL);
+
+        if (memory != NULL)
+            vkFreeMemory(device, memory, NULL);
+
+        return uploaded ? elapsed : -1.0;
+    }
+};
+
+// MARK: Benchmark
+
+inline uint64_t getPeakWorkingSet()
+{
+    PROCESS_MEMORY_COUNTERS counters = {};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+
+    return counters.PeakWorkingSetSize;
+}
+
+inline std::string escapeJson(const char *text)
+{
+    std::string escaped = {};
+
+    for (; *text != '\0'; text++)
+    {
+        if (*text == '\\' || *text == '"')
+            escaped += '\\';
+
+        escaped += *text;
+    }
+
+    return escaped;
+}
+
+// Loads and uploads one mesh and prints its results as a single line of JSON.
+int runBenchmark(const char *path, bool optimize)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+
+    if (GetFileAttributesExA(path, GetFileExInfoStandard, &attributes) == FALSE)
+    {
+        printf("Failed to find %s\n", path);
+        return 1;
+    }
+
+    uint64_t size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+
+    // Created before loading so the driver's own memory is part of the baseline rather than of the load.
+    UploadDevice uploadDevice = {};
+    bool hasDevice = uploadDevice.initialize();
+
+    uint64_t baselineWorkingSet = getPeakWorkingSet();
+
+    ObjLoadInfo loadInfo = {
+        .optimizeMesh = optimize,
+        .maxLods = optimize ? MESH_MAX_LODS : 1,
+        .useCache = false,
+    };
+
+    Obj mesh = Obj(path, loadInfo);
+
+    // The loader has said why, and a result line would read as a very fast load.
+    if (mesh.lods.empty())
+    {
+        printf("Failed to load %s\n", path);
+        return 1;
+    }
+
+    double upload = hasDevice ? uploadDevice.upload(mesh) : -1.0;
+    uint64_t peakWorkingSet = getPeakWorkingSet();
+    const ObjLoadTimings &timings = mesh.timings;
+    unsigned numTriangles = mesh.lods[0].numIndices / 3;
+    double total = timings.total + std::max(upload, 0.0);
+
+    printf("{\"file\": \"%s\", \"bytes\": %llu, \"triangles\": %u, \"vertices\": %u, ", escapeJson(path).c_str(), (unsigned long long)size, numTriangles, mesh.numVertices);
+    printf("\"seconds\": {\"read\": %.6f, \"count\": %.6f, \"parse\": %.6f, \"normals\": %.6f, \"build\": %.6f, \"simplify\": %.6f, \"optimize\": %.6f, \"meshlets\": %.6f, \"quantize\": %.6f, \"cache\": %.6f, ", timings.read, timings.count, timings.parse, timings.normals, timings.build, timings.simplify, timings.optimize, timings.meshlets, timings.quantize, timings.cache);
+
+    if (upload >= 0.0)
+        printf("\"upload\": %.6f, ", upload);
+    else
+        printf("\"upload\": null, ");
+
+    printf("\"total\": %.6f}, \"megabytesPerSecond\": %.2f, \"trianglesPerSecond\": %.0f, ", total, total > 0.0 ? size / total / 1e6 : 0.0, total > 0.0 ? numTriangles / total : 0.0);
+    printf("\"baselineWorkingSetBytes\": %llu, \"peakWorkingSetBytes\": %llu}\n", (unsigned long long)baselineWorkingSet, (unsigned long long)peakWorkingSet);
+
+    return 0;
+}
+
+// Runs `--run` for `path` in a child process and appends its JSON line to `results`. Everything else the child prints goes to stderr.
+inline bool runChild(const char *executable, const char *path, bool optimize, std::vector<std::string> &results)
+{
+    std::string command = "\"\"" + std::string(executable) + "\" --run \"" + path + "\"" + (optimize ? " --optimize" : "") + "\"";
+    FILE *child = _popen(command.c_str(), "r");
+
+    if (child == NULL)
+    {
+        printf("Failed to start the benchmark for %s\n", path);
+        return false;
+    }
+
+    std::string result = {};
+    char line[4096] = {};
+
+    while (fgets(line, sizeof(line), child) != NULL)
+    {
+        if (line[0] == '{')
+            result = line;
+        else
+            fputs(line, stderr);
+    }
+
+    int status = _pclose(child);
+
+    if (status != 0 || result.empty())
+    {
+        fprintf(stderr, "No result for %s\n", path);
+        return false;
+    }
+
+    while (result.empty() == false && (result.back() == '\n' || result.back() == '\r'))
+        result.pop_back();
+
+    results.push_back(result);
+
+    return true;
+}
+
+std::vector<std::string> splitList(const char *list)
+{
+    std::vector<std::string> items = {};
+    std::string item = {};
+
+    for (; *list != '\0'; list++)
+    {
+        if (*list == ',')
+        {
+            items.push_back(item);
+            item.clear();
+        }
+        else
+        {
+            item += *list;
+        }
+    }
+
+    if (item.empty() == false)
+        items.push_back(item);
+
+    return items;
+}
+
+// MARK: Entrypoint
+
+int main(int argc, char *argv[])
+{
+    const char *runPath = nullptr;
+    const char *dataDirectory = "bench-data";
+    const char *outputPath = nullptr;
+    std::vector<std::string> sizes = {"1", "10"};
+    std::vector<std::string> styles(numberStyleNames.begin(), numberStyleNames.end());
+    bool optimize = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(argv[i], "--run") == 0 && hasValue)
+            runPath = argv[++i];
+        else if (strcmp(argv[i], "--sizes") == 0 && hasValue)
+            sizes = splitList(argv[++i]);
+        else if (strcmp(argv[i], "--styles") == 0 && hasValue)
+            styles = splitList(argv[++i]);
+        else if (strcmp(argv[i], "--data") == 0 && hasValue)
+            dataDirectory = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0 && hasValue)
+            outputPath = argv[++i];
+        else if (strcmp(argv[i], "--optimize") == 0)
+            optimize = true;
+        else
+        {
+            printf("Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (runPath != nullptr)
+        return runBenchmark(runPath, optimize);
+
+    std::vector<std::string> paths = {"res/bunny.obj"};
+
+    CreateDirectoryA(dataDirectory, NULL);
+
+    // Generated files are kept between runs, as writing the largest ones takes longer than loading them.
+    for (const auto &size : sizes)
+    {
+        for (const auto &styleName : styles)
+        {
+            auto style = std::find(numberStyleNames.begin(), numberStyleNames.end(), styleName);
+
+            if (style == numberStyleNames.end())
+            {
+                printf("Unknown number style %s\n", styleName.c_str());
+                return 1;
+            }
+
+            std::string path = std::string(dataDirectory) + "/" + styleName + "-" + size + "m.obj";
+
+            if (GetFileAttributesA(path.c_str()) == INVALID_FILE_ATTRIBUTES)
+            {
+                fprintf(stderr, "Generating %s\n", path.c_str());
+
+                if (generateObj(path.c_str(), strtoull(size.c_str(), NULL, 10) * 1000000, (ObjNumberStyle)(style - numberStyleNames.begin())) == false)
+                    return 1;
+            }
+
+            paths.push_back(path);
+        }
+    }
+
+    char executable[MAX_PATH] = {};
+    GetModuleFileNameA(NULL, executable, MAX_PATH);
+
+    std::vector<std::string> results = {};
+
+    for (const auto &path : paths)
+        runChild(executable, path.c_str(), optimize, results);
+
+    FILE *output = outputPath != nullptr ? fopen(outputPath, "wb") : stdout;
+
+    if (output == NULL)
+    {
+        printf("Failed to create %s\n", outputPath);
+        return 1;
+    }
+
+    fprintf(output, "{\"optimize\": %s, \"results\": [\n", optimize ? "true" : "false");
+
+    for (size_t i = 0; i < results.size(); i++)
+        fprintf(output, "    %s%s\n", results[i].c_str(), i + 1 < results.size() ? "," : "");
+
+    fprintf(output, "]}\n");
+
+    if (output != stdout)
+        fclose(output);
+
+    return results.size() == paths.size() ? 0 : 1;
+}